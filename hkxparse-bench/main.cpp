@@ -0,0 +1,129 @@
+#include <hkxparse/Deserializer.h>
+
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/*
+ * Times the tagfile varint decoders over a buffer of encoded values:
+ * the byte-by-byte loop readVarInt used to be, readVarInt, and
+ * readVarInts. Usage: hkxparse-bench [value count] [runs]
+ */
+
+using Clock = std::chrono::steady_clock;
+
+static void encodeVarInt(std::vector<unsigned char> &target, int32_t value) {
+	uint32_t magnitude = value < 0 ? 0U - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+	unsigned int byte = ((magnitude & 0x3F) << 1) | (value < 0 ? 1 : 0);
+	magnitude >>= 6;
+
+	while (magnitude) {
+		target.push_back(static_cast<unsigned char>(byte | 0x80));
+		byte = magnitude & 0x7F;
+		magnitude >>= 7;
+	}
+
+	target.push_back(static_cast<unsigned char>(byte));
+}
+
+// Deserializer::readVarInt as it was before it was unrolled: out of line, with a bounds check per byte
+static int32_t decodeByteLoop(const unsigned char *&ptr, const unsigned char *end) {
+	auto readByte = [&]() {
+		if (ptr == end) {
+			hkxparse::throwDeserializerError("out of bounds read");
+		}
+
+		return *ptr++;
+	};
+
+	auto byte = readByte();
+	bool negative = byte & 1;
+	uint32_t value = (byte & 0x7E) >> 1;
+	size_t pos = 6;
+
+	while (byte & 0x80) {
+		byte = readByte();
+		value |= (byte & 0x7F) << pos;
+		pos += 7;
+	}
+
+	return negative ? -static_cast<int32_t>(value) : static_cast<int32_t>(value);
+}
+
+// Called through a volatile pointer, so that it is not inlined, as it was not.
+static int32_t (*volatile decodeByteLoopFunction)(const unsigned char *&ptr, const unsigned char *end) = decodeByteLoop;
+
+template<typename Function>
+static double medianMilliseconds(unsigned int runs, Function &&function) {
+	std::vector<double> times;
+
+	for (unsigned int run = 0; run < runs; run++) {
+		auto start = Clock::now();
+		function();
+		times.push_back(std::chrono::duration<double, std::milli>(Clock::now() - start).count());
+	}
+
+	std::sort(times.begin(), times.end());
+	return times[times.size() / 2];
+}
+
+static bool benchmark(const char *name, size_t count, unsigned int runs, int32_t minimum, int32_t maximum) {
+	std::mt19937 random(1);
+	std::uniform_int_distribution<int32_t> distribution(minimum, maximum);
+
+	std::vector<int32_t> values(count);
+	std::vector<unsigned char> encoded;
+
+	for (auto &value : values) {
+		value = distribution(random);
+		encodeVarInt(encoded, value);
+	}
+
+	hkxparse::LayoutRules rules = { 0, 1, 0, 0 };
+	std::vector<int32_t> decoded(count);
+	bool ok = true;
+
+	auto byteLoop = medianMilliseconds(runs, [&]() {
+		const unsigned char *ptr = encoded.data();
+		auto decode = decodeByteLoopFunction;
+		for (auto &value : decoded)
+			value = decode(ptr, encoded.data() + encoded.size());
+	});
+	ok = ok && decoded == values;
+
+	auto single = medianMilliseconds(runs, [&]() {
+		hkxparse::Deserializer stream(rules, encoded.data(), encoded.size());
+		for (auto &value : decoded)
+			value = stream.readVarInt();
+	});
+	ok = ok && decoded == values;
+
+	auto bulk = medianMilliseconds(runs, [&]() {
+		hkxparse::Deserializer stream(rules, encoded.data(), encoded.size());
+		stream.readVarInts(decoded.data(), decoded.size());
+	});
+	ok = ok && decoded == values;
+
+	printf("%-16s %8.1f ms %12.1f ms %13.1f ms %s\n", name, byteLoop, single, bulk, ok ? "" : "MISMATCH");
+
+	return ok;
+}
+
+int main(int argc, char *argv[]) {
+	size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 20000000;
+	unsigned int runs = argc > 2 ? static_cast<unsigned int>(strtoul(argv[2], nullptr, 10)) : 3;
+
+	printf("%zu values, median of %u runs\n", count, runs);
+	printf("%-16s %11s %15s %16s\n", "values", "byte loop", "readVarInt", "readVarInts");
+
+	bool ok = true;
+	ok = benchmark("1 byte", count, runs, -32, 31) && ok;
+	ok = benchmark("mixed 1-3 byte", count, runs, -100, 69899) && ok;
+	ok = benchmark("any", count, runs, INT32_MIN + 1, INT32_MAX) && ok;
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "HKXTest.h"
+#include "Fixtures.h"
+
+#include <hkxparse/Deserializer.h>
+#include <hkxparse/HavokPackfileLayouts.h>
+#include <hkxparse/HavokReflectionTypes.h>
+
+#include <limits>
+#include <stdexcept>
+
+using namespace hkxparse;
+using namespace hkxparse::test;
+
+static const int32_t varIntValues[] = {
+	0, 1, -1, 63, -63, 64, -64, 127, 128, 8191, 8192, -8192, 1048575, 1048576,
+	123456789, -123456789, std::numeric_limits<int32_t>::max(), -std::numeric_limits<int32_t>::max()
+};
+
+HKX_TEST(varIntRoundTrips) {
+	for (auto value : varIntValues) {
+		std::vector<unsigned char> encoded;
+		appendVarInt(encoded, value);
+
+		// Once with the value at the very end of the buffer, once with plenty of room after it.
+		for (size_t padding : { 0, 16 }) {
+			auto buffer = encoded;
+			buffer.resize(encoded.size() + padding, 0xFF);
+
+			const unsigned char *ptr = buffer.data();
+			HKX_CHECK(readVarInt(ptr, buffer.data() + buffer.size()) == value);
+			HKX_CHECK(ptr == buffer.data() + encoded.size());
+		}
+	}
+}
+
+HKX_TEST(varIntTruncationThrows) {
+	for (auto value : varIntValues) {
+		std::vector<unsigned char> encoded;
+		appendVarInt(encoded, value);
+
+		for (size_t length = 0; length < encoded.size(); length++) {
+			const unsigned char *ptr = encoded.data();
+			HKX_CHECK_THROWS(readVarInt(ptr, encoded.data() + length), std::runtime_error);
+		}
+	}
+}
+
+HKX_TEST(varIntBulkMatchesSingleReads) {
+	std::vector<unsigned char> encoded;
+	std::vector<int32_t> expected;
+
+	for (size_t repeat = 0; repeat < 4; repeat++) {
+		for (auto value : varIntValues) {
+			appendVarInt(encoded, value);
+			expected.push_back(value);
+		}
+	}
+
+	std::vector<int32_t> values(expected.size());
+	const unsigned char *ptr = encoded.data();
+	readVarInts(ptr, encoded.data() + encoded.size(), values.data(), values.size());
+
+	HKX_CHECK(values == expected);
+	HKX_CHECK(ptr == encoded.data() + encoded.size());
+
+	ptr = encoded.data();
+	HKX_CHECK_THROWS(readVarInts(ptr, encoded.data() + encoded.size() - 1, values.data(), values.size()), std::runtime_error);
+}
+
+HKX_TEST(deserializerSwapsBigEndianScalars) {
+	const unsigned char data[] = {
+		0x12, 0x34,
+		0x12, 0x34, 0x56, 0x78,
+		0x3F, 0x80, 0x00, 0x00,
+		0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08
+	};
+
+	LayoutRules rules = { 4, 0, 0, 1 };
+	Deserializer stream(rules, data, sizeof(data));
+
+	uint16_t u16;
+	uint32_t u32;
+	float real;
+	uint64_t u64;
+	stream >> u16 >> u32 >> real >> u64;
+
+	HKX_CHECK(u16 == 0x1234);
+	HKX_CHECK(u32 == 0x12345678);
+	HKX_CHECK(real == 1.0f);
+	HKX_CHECK(u64 == 0x0102030405060708ULL);
+	HKX_CHECK_THROWS(stream >> u16, std::runtime_error);
+
+	Deserializer again(rules, data + 2, 4);
+	uint16_t pair[2];
+	again.readU16s(pair, 2);
+	HKX_CHECK(pair[0] == 0x1234 && pair[1] == 0x5678);
+}
+
+HKX_TEST(layoutNameLookups) {
+	auto layout = PackfileBuilder::layout();
+
+	for (unsigned int index = 0; index < layout->classCount; index++) {
+		HKX_CHECK(findClassIndex(layout, layout->classes[index]->name) == static_cast<int>(index));
+	}
+
+	for (unsigned int index = 0; index < layout->typeInfoCount; index++) {
+		HKX_CHECK(findTypeInfoIndex(layout, layout->typeInfos[index]->name) == static_cast<int>(index));
+	}
+
+	for (auto name : { "", "hkaSkeletonX", "hkaSkeleto", "HKASKELETON", "hkaskeleton" }) {
+		HKX_CHECK(findClassIndex(layout, name) == -1);
+		HKX_CHECK(findTypeInfoIndex(layout, name) == -1);
+	}
+}
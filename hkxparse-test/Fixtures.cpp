@@ -0,0 +1,560 @@
+#include "Fixtures.h"
+
+#include <hkxparse/HavokPackfileLayouts.h>
+#include <hkxparse/HavokReflectionTypes.h>
+#include <hkxparse/PackfileTypes.h>
+#include <hkxparse/PrettyPrinter.h>
+#include <hkxparse/TagfileTypes.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace hkxparse {
+	namespace test {
+		static const unsigned char fixtureLayoutRules[4] = { 4, 1, 0, 1 };
+		static const char fixtureContentsVersion[] = "hk_2010.2.0-r1";
+
+		PackfileBuilder::PackfileBuilder() {
+
+		}
+
+		const HavokPackfileLayout *PackfileBuilder::layout() {
+			auto layout = findLayout(fixtureContentsVersion, fixtureLayoutRules);
+			if (!layout)
+				throw std::logic_error("the fixture layout is missing");
+
+			return layout;
+		}
+
+		const HavokClass *PackfileBuilder::findClass(const char *className) {
+			auto layout = PackfileBuilder::layout();
+
+			auto index = findClassIndex(layout, className);
+			if (index < 0)
+				throw std::logic_error(std::string("no class ") + className + " in the fixture layout");
+
+			return layout->classes[index];
+		}
+
+		uint32_t PackfileBuilder::offsetOf(const char *className, const char *memberName) {
+			for (auto classInChain = findClass(className); classInChain; classInChain = classInChain->parent) {
+				for (size_t index = 0; index < classInChain->numDeclaredMembers; index++) {
+					const auto &member = classInChain->declaredMembers[index];
+
+					if (strcmp(member.name, memberName) == 0)
+						return member.offset;
+				}
+			}
+
+			throw std::logic_error(std::string("no member ") + memberName + " in " + className);
+		}
+
+		uint32_t PackfileBuilder::sizeOf(const char *className) {
+			return static_cast<uint32_t>(findClass(className)->objectSize);
+		}
+
+		uint32_t PackfileBuilder::allocate(size_t size, size_t alignment) {
+			while (m_data.size() % alignment != 0)
+				m_data.push_back(0);
+
+			auto offset = static_cast<uint32_t>(m_data.size());
+			m_data.resize(m_data.size() + size);
+
+			return offset;
+		}
+
+		uint32_t PackfileBuilder::object(const char *className) {
+			auto size = sizeOf(className);
+			auto offset = allocate(size);
+
+			m_virtualFixups.insert(m_virtualFixups.end(), { offset, 0, this->className(className) });
+
+			// hkReferencedObject::memSizeAndFlags and referenceCount
+			write<uint16_t>(offset + 4, static_cast<uint16_t>(size));
+			write<uint16_t>(offset + 6, 1);
+
+			return offset;
+		}
+
+		uint32_t PackfileBuilder::string(const char *text) {
+			auto length = strlen(text);
+			auto offset = allocate(length + 1, 1);
+			memcpy(m_data.data() + offset, text, length);
+
+			return offset;
+		}
+
+		void PackfileBuilder::pointer(uint32_t at, uint32_t target) {
+			m_localFixups.insert(m_localFixups.end(), { at, target });
+		}
+
+		void PackfileBuilder::array(uint32_t at, uint32_t target, uint32_t count) {
+			if (count != 0)
+				pointer(at, target);
+
+			write<uint32_t>(at + 4, count);
+			write<uint32_t>(at + 8, count | 0x80000000);
+		}
+
+		uint32_t PackfileBuilder::className(const char *name) {
+			auto it = m_classNameOffsets.find(name);
+			if (it != m_classNameOffsets.end())
+				return it->second;
+
+			// Each name follows its class signature and a tab.
+			m_classNames.resize(m_classNames.size() + 5, 0);
+			m_classNames.back() = '\t';
+
+			auto offset = static_cast<uint32_t>(m_classNames.size());
+			m_classNames.insert(m_classNames.end(), name, name + strlen(name) + 1);
+
+			m_classNameOffsets.emplace(name, offset);
+
+			return offset;
+		}
+
+		template<typename T>
+		static void append(std::vector<unsigned char> &target, const T &value) {
+			auto bytes = reinterpret_cast<const unsigned char *>(&value);
+			target.insert(target.end(), bytes, bytes + sizeof(value));
+		}
+
+		static void pad(std::vector<unsigned char> &target, unsigned char filler) {
+			while (target.size() % 16 != 0)
+				target.push_back(filler);
+		}
+
+		std::vector<unsigned char> PackfileBuilder::finish(uint32_t root, const char *rootClass) {
+			auto rootClassName = className(rootClass);
+
+			std::vector<unsigned char> sections[2] = { m_classNames, m_data };
+			const char *tags[2] = { "__classnames__", "__data__" };
+			PackfileSectionHeader sectionHeaders[2];
+			std::vector<unsigned char> bodies[2];
+
+			auto position = static_cast<int32_t>(sizeof(PackfileHeader) + sizeof(sectionHeaders));
+
+			for (size_t index = 0; index < 2; index++) {
+				auto &body = bodies[index];
+				body = sections[index];
+				pad(body, 0xFF);
+
+				auto dataSize = static_cast<int32_t>(body.size());
+
+				if (index == 1) {
+					for (auto value : m_localFixups)
+						append(body, value);
+
+					pad(body, 0xFF);
+				}
+
+				auto virtualFixupsOffset = static_cast<int32_t>(body.size());
+
+				if (index == 1) {
+					for (auto value : m_virtualFixups)
+						append(body, value);
+
+					pad(body, 0xFF);
+				}
+
+				auto end = static_cast<int32_t>(body.size());
+
+				auto &header = sectionHeaders[index];
+				memset(&header, 0, sizeof(header));
+				strcpy(header.sectionTag, tags[index]);
+				header.absoluteDataStart = position;
+				header.localFixupsOffset = dataSize;
+				header.globalFixupsOffset = virtualFixupsOffset;
+				header.virtualFixupsOffset = virtualFixupsOffset;
+				header.exportsOffset = end;
+				header.importsOffset = end;
+				header.endOffset = end;
+
+				position += end;
+			}
+
+			PackfileHeader header;
+			memset(&header, 0, sizeof(header));
+			header.magic0 = PackfileMagic0;
+			header.magic1 = PackfileMagic1;
+			header.fileVersion = 8;
+			memcpy(&header.layoutRules, fixtureLayoutRules, sizeof(fixtureLayoutRules));
+			header.numSections = 2;
+			header.contentsSectionIndex = 1;
+			header.contentsSectionOffset = static_cast<int32_t>(root);
+			header.contentsClassNameSectionIndex = 0;
+			header.contentsClassNameSectionOffset = static_cast<int32_t>(rootClassName);
+			strcpy(header.contentsVersion, fixtureContentsVersion);
+
+			std::vector<unsigned char> contents;
+			append(contents, header);
+			append(contents, sectionHeaders);
+
+			for (const auto &body : bodies)
+				contents.insert(contents.end(), body.begin(), body.end());
+
+			return contents;
+		}
+
+		TagfileBuilder::TagfileBuilder(bool bigEndian) : m_bigEndian(bigEndian) {
+			uint32_t magic[2] = { TagfileMagic0, TagfileMagic1 };
+
+			for (auto value : magic) {
+				for (size_t index = 0; index < 4; index++)
+					m_data.push_back(static_cast<unsigned char>(value >> (m_bigEndian ? 24 - index * 8 : index * 8)));
+			}
+		}
+
+		void TagfileBuilder::type(const char *name, int32_t parent, const std::vector<Member> &members) {
+			varInt(TagMetadata);
+			string(name);
+			varInt(0);
+			varInt(parent);
+			varInt(static_cast<int32_t>(members.size()));
+
+			for (const auto &member : members) {
+				string(member.name);
+				varInt(member.type);
+
+				if (member.type & TagTupleFlag)
+					varInt(member.tupleSize);
+
+				auto basicType = member.type & TagBasicTypeMask;
+				if (basicType == TagTypeObject || basicType == TagTypeStruct)
+					string(member.className);
+			}
+		}
+
+		void TagfileBuilder::varInt(int32_t value) {
+			appendVarInt(m_data, value);
+		}
+
+		void TagfileBuilder::string(const std::string &text) {
+			auto it = m_strings.find(text);
+			if (it != m_strings.end()) {
+				varInt(-it->second);
+				return;
+			}
+
+			// The first two string pool indices are reserved.
+			m_strings.emplace(text, static_cast<int32_t>(m_strings.size() + 2));
+
+			varInt(static_cast<int32_t>(text.size()));
+			m_data.insert(m_data.end(), text.begin(), text.end());
+		}
+
+		void TagfileBuilder::real(float value) {
+			uint32_t bits;
+			memcpy(&bits, &value, sizeof(bits));
+
+			for (size_t index = 0; index < 4; index++)
+				m_data.push_back(static_cast<unsigned char>(bits >> (m_bigEndian ? 24 - index * 8 : index * 8)));
+		}
+
+		void TagfileBuilder::byte(uint8_t value) {
+			m_data.push_back(value);
+		}
+
+		std::vector<unsigned char> TagfileBuilder::finish() {
+			varInt(TagFileEnd);
+
+			return m_data;
+		}
+
+		void appendVarInt(std::vector<unsigned char> &target, int32_t value) {
+			auto negative = value < 0;
+			auto magnitude = negative ? 0U - static_cast<uint32_t>(value) : static_cast<uint32_t>(value);
+
+			auto byte = ((magnitude & 0x3F) << 1) | (negative ? 1 : 0);
+			magnitude >>= 6;
+
+			while (magnitude != 0) {
+				target.push_back(static_cast<unsigned char>(byte | 0x80));
+				byte = magnitude & 0x7F;
+				magnitude >>= 7;
+			}
+
+			target.push_back(static_cast<unsigned char>(byte));
+		}
+
+		std::vector<unsigned char> skeletonPackfile(size_t skeletonCount, size_t boneCount) {
+			PackfileBuilder builder;
+
+			auto root = builder.allocate(PackfileBuilder::sizeOf("hkRootLevelContainer"));
+			auto variant = builder.allocate(PackfileBuilder::sizeOf("hkRootLevelContainerNamedVariant"));
+			builder.array(root + PackfileBuilder::offsetOf("hkRootLevelContainer", "namedVariants"), variant, 1);
+
+			auto container = builder.object("hkaAnimationContainer");
+			builder.pointer(variant + PackfileBuilder::offsetOf("hkRootLevelContainerNamedVariant", "name"), builder.string("Merged Animation Container"));
+			builder.pointer(variant + PackfileBuilder::offsetOf("hkRootLevelContainerNamedVariant", "className"), builder.string("hkaAnimationContainer"));
+			builder.pointer(variant + PackfileBuilder::offsetOf("hkRootLevelContainerNamedVariant", "variant"), container);
+
+			auto skeletons = builder.allocate(4 * skeletonCount);
+			builder.array(container + PackfileBuilder::offsetOf("hkaAnimationContainer", "skeletons"), skeletons, static_cast<uint32_t>(skeletonCount));
+
+			auto frame = builder.object("hkSimpleLocalFrame");
+			auto transform = frame + PackfileBuilder::offsetOf("hkSimpleLocalFrame", "transform");
+			for (uint32_t index = 0; index < 16; index++)
+				builder.write<float>(transform + 4 * index, index * 0.5f);
+
+			builder.pointer(frame + PackfileBuilder::offsetOf("hkSimpleLocalFrame", "name"), builder.string("frame"));
+
+			auto boneSize = PackfileBuilder::sizeOf("hkaBone");
+			auto frameOnBoneSize = PackfileBuilder::sizeOf("hkaSkeletonLocalFrameOnBone");
+
+			for (size_t skeletonIndex = 0; skeletonIndex < skeletonCount; skeletonIndex++) {
+				auto skeleton = builder.object("hkaSkeleton");
+				builder.pointer(skeletons + 4 * static_cast<uint32_t>(skeletonIndex), skeleton);
+
+				auto name = "skeleton" + std::to_string(skeletonIndex);
+				builder.pointer(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "name"), builder.string(name.c_str()));
+
+				auto parentIndices = builder.allocate(2 * boneCount);
+				for (size_t bone = 0; bone < boneCount; bone++)
+					builder.write<int16_t>(parentIndices + 2 * static_cast<uint32_t>(bone), static_cast<int16_t>(bone) - 1);
+
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "parentIndices"), parentIndices, static_cast<uint32_t>(boneCount));
+
+				auto bones = builder.allocate(boneSize * boneCount);
+				for (size_t bone = 0; bone < boneCount; bone++) {
+					auto entry = bones + boneSize * static_cast<uint32_t>(bone);
+					auto boneName = "bone" + std::to_string(skeletonIndex) + "_" + std::to_string(bone);
+					builder.pointer(entry + PackfileBuilder::offsetOf("hkaBone", "name"), builder.string(boneName.c_str()));
+					builder.write<uint8_t>(entry + PackfileBuilder::offsetOf("hkaBone", "lockTranslation"), bone & 1);
+				}
+
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "bones"), bones, static_cast<uint32_t>(boneCount));
+
+				auto pose = builder.allocate(48 * boneCount);
+				for (size_t index = 0; index < boneCount * 12; index++)
+					builder.write<float>(pose + 4 * static_cast<uint32_t>(index), index * 0.25f + skeletonIndex);
+
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "referencePose"), pose, static_cast<uint32_t>(boneCount));
+
+				auto floats = builder.allocate(8);
+				builder.write<float>(floats, 1.5f);
+				builder.write<float>(floats + 4, 2.5f);
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "referenceFloats"), floats, 2);
+
+				auto slots = builder.allocate(4);
+				builder.pointer(slots, builder.string(("slot" + std::to_string(skeletonIndex)).c_str()));
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "floatSlots"), slots, 1);
+
+				auto frames = builder.allocate(frameOnBoneSize);
+				builder.pointer(frames + PackfileBuilder::offsetOf("hkaSkeletonLocalFrameOnBone", "localFrame"), frame);
+				builder.write<int32_t>(frames + PackfileBuilder::offsetOf("hkaSkeletonLocalFrameOnBone", "boneIndex"), static_cast<int32_t>(skeletonIndex));
+				builder.array(skeleton + PackfileBuilder::offsetOf("hkaSkeleton", "localFrames"), frames, 1);
+			}
+
+			return builder.finish(root, "hkRootLevelContainer");
+		}
+
+		std::vector<unsigned char> nodeTagfile(size_t count, bool bigEndian) {
+			TagfileBuilder builder(bigEndian);
+
+			builder.varInt(TagFileInfo);
+			builder.varInt(3);
+
+			builder.type("Pair", 0, { // 1
+				{ "a", TagTypeInt, "", 0 },
+				{ "b", TagTypeReal, "", 0 }
+			});
+
+			builder.type("Base", 0, { // 2
+				{ "name", TagTypeCString, "", 0 },
+				{ "id", TagTypeInt, "", 0 },
+				{ "w", TagTypeReal, "", 0 }
+			});
+
+			builder.type("Node", 2, { // 3
+				{ "pos", TagTypeVec4, "", 0 },
+				{ "pair", TagTypeStruct, "Pair", 0 },
+				{ "pairs", TagArrayFlag | TagTypeStruct, "Pair", 0 },
+				{ "ints", TagArrayFlag | TagTypeInt, "", 0 },
+				{ "child", TagTypeObject, "Node", 0 },
+				{ "kids", TagArrayFlag | TagTypeObject, "Node", 0 },
+				{ "bytes", TagArrayFlag | TagTypeByte, "", 0 },
+				{ "m", TagTupleFlag | TagTypeVec4, "", 3 },
+				{ "extra", TagTypeInt, "", 0 },
+				{ "late", TagTypeStruct, "Late", 0 } // declared after Node
+			});
+
+			builder.type("Late", 0, { // 4
+				{ "x", TagTypeInt, "", 0 },
+				{ "reals", TagArrayFlag | TagTypeReal, "", 0 },
+				{ "v4", TagArrayFlag | TagTypeVec4, "", 0 },
+				{ "m3", TagArrayFlag | TagTypeVec12, "", 0 },
+				{ "m4", TagArrayFlag | TagTypeVec16, "", 0 }
+			});
+
+			for (size_t node = 0; node < count; node++) {
+				auto k = static_cast<int32_t>(node);
+
+				builder.varInt(TagObjectRemember);
+				builder.varInt(3);
+
+				// 13 members; w is left out of the even nodes.
+				unsigned int bits = (1 << 13) - 1;
+				if (k % 2 == 0)
+					bits &= ~(1U << 2);
+
+				builder.byte(static_cast<uint8_t>(bits));
+				builder.byte(static_cast<uint8_t>(bits >> 8));
+
+				builder.string("node" + std::to_string(k));
+				builder.varInt(k * 7 - 3);
+
+				if (bits & 4)
+					builder.real(k + 0.5f);
+
+				for (int index = 1; index <= 4; index++)
+					builder.real(static_cast<float>(index));
+
+				// pair
+				builder.byte(3);
+				builder.varInt(k);
+				builder.real(k * 2.0f);
+
+				// pairs: a member bitmap, then one column per member
+				builder.varInt(4);
+				builder.byte(3);
+				builder.varInt(0);
+				for (int index = 0; index < 4; index++)
+					builder.varInt(index - 2);
+				for (int index = 0; index < 4; index++)
+					builder.real(index / 4.0f);
+
+				// ints
+				builder.varInt(5);
+				builder.varInt(4);
+				for (int index = 0; index < 5; index++)
+					builder.varInt(index * 100 - k);
+
+				// child: the next node, if any
+				builder.varInt(node + 1 < count ? k + 2 : 0);
+
+				// kids
+				builder.varInt(2);
+				builder.varInt(1);
+				builder.varInt(0);
+
+				// bytes
+				builder.varInt(3);
+				builder.byte('x');
+				builder.byte('y');
+				builder.byte('z');
+
+				// m
+				builder.varInt(4);
+				for (int index = 0; index < 12; index++)
+					builder.real(static_cast<float>(index));
+
+				builder.varInt(-k);
+
+				// late
+				builder.byte(0x1F);
+				builder.varInt(42);
+
+				builder.varInt(5);
+				for (int index = 0; index < 5; index++)
+					builder.real(index * 1.25f + k);
+
+				builder.varInt(3);
+				builder.varInt(4);
+				for (int index = 0; index < 12; index++)
+					builder.real(static_cast<float>(index));
+
+				builder.varInt(2);
+				for (int index = 0; index < 24; index++)
+					builder.real(static_cast<float>(index));
+
+				builder.varInt(2);
+				for (int index = 0; index < 32; index++)
+					builder.real(static_cast<float>(-index));
+			}
+
+			return builder.finish();
+		}
+
+		HKXMapping toMapping(const std::vector<unsigned char> &contents) {
+			HKXMapping mapping(contents.size());
+			memcpy(mapping.data(), contents.data(), contents.size());
+
+			return mapping;
+		}
+
+		TemporaryFile::TemporaryFile(const char *name, const std::vector<unsigned char> &contents) : m_path((std::filesystem::temp_directory_path() / name).string()) {
+			std::ofstream stream(m_path, std::ios::out | std::ios::binary | std::ios::trunc);
+			stream.write(reinterpret_cast<const char *>(contents.data()), contents.size());
+
+			if (!stream)
+				throw std::runtime_error("unable to write " + m_path);
+		}
+
+		TemporaryFile::~TemporaryFile() {
+			std::error_code error;
+			std::filesystem::remove(m_path, error);
+		}
+
+		std::string_view text(const HKXVariant &value) {
+			if (auto view = std::get_if<HKXStringView>(&value))
+				return *view;
+
+			return std::get<HKXString>(value);
+		}
+
+		std::string dump(const HKXStructRef &root) {
+			std::stringstream stream;
+
+			{
+				PrettyPrinter printer(stream);
+				printer.print(root);
+			}
+
+			// Addresses are numbered in the order they are first printed.
+			auto text = stream.str();
+			std::unordered_map<std::string, size_t> addresses;
+			std::string result;
+			size_t position = 0;
+
+			for (;;) {
+				auto ref = text.find("REF:", position);
+				if (ref == std::string::npos)
+					break;
+
+				auto start = ref + 4;
+				auto end = text.find_first_not_of("0123456789", start);
+				if (end == std::string::npos)
+					end = text.size();
+
+				auto address = text.substr(start, end - start);
+
+				result.append(text, position, start - position);
+
+				if (address == "0") {
+					result += "null";
+				}
+				else {
+					auto id = addresses.emplace(address, addresses.size() + 1).first->second;
+					result += "#" + std::to_string(id);
+				}
+
+				position = end;
+			}
+
+			result.append(text, position, std::string::npos);
+
+			return result;
+		}
+
+		std::string load(const std::vector<unsigned char> &contents, const HKXLoadOptions &options) {
+			HKXFile file;
+			file.setOptions(options);
+			file.loadFile(toMapping(contents));
+
+			return dump(file.root());
+		}
+	}
+}
@@ -0,0 +1,132 @@
+#ifndef HKXPARSE_TEST_FIXTURES_H
+#define HKXPARSE_TEST_FIXTURES_H
+
+#include <hkxparse/HKXFile.h>
+#include <hkxparse/HKXLoadOptions.h>
+#include <hkxparse/HKXMapping.h>
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+
+namespace hkxparse {
+	struct HavokClass;
+	struct HavokPackfileLayout;
+
+	namespace test {
+		/*
+		 * Builds a hk_2010.2.0-r1 packfile with 4-1-0-1 layout rules, the one
+		 * layout in the tree, in memory: a __classnames__ section and a
+		 * __data__ section with local and virtual fixups. Member offsets and
+		 * object sizes are taken from the layout reflection.
+		 */
+		class PackfileBuilder {
+		public:
+			PackfileBuilder();
+
+			static const HavokPackfileLayout *layout();
+			static const HavokClass *findClass(const char *className);
+			static uint32_t offsetOf(const char *className, const char *memberName);
+			static uint32_t sizeOf(const char *className);
+
+			uint32_t allocate(size_t size, size_t alignment = 16);
+
+			// An object with a vtable, listed in the virtual fixups.
+			uint32_t object(const char *className);
+
+			uint32_t string(const char *text);
+			void pointer(uint32_t at, uint32_t target);
+			void array(uint32_t at, uint32_t target, uint32_t count);
+
+			template<typename T>
+			void write(uint32_t at, const T &value) {
+				memcpy(m_data.data() + at, &value, sizeof(value));
+			}
+
+			std::vector<unsigned char> finish(uint32_t root, const char *rootClass);
+
+		private:
+			uint32_t className(const char *name);
+
+			std::vector<unsigned char> m_classNames;
+			std::unordered_map<std::string, uint32_t> m_classNameOffsets;
+			std::vector<unsigned char> m_data;
+			std::vector<uint32_t> m_localFixups; // offset, target
+			std::vector<uint32_t> m_virtualFixups; // offset, section, class name offset
+		};
+
+		// Builds a version 3 tagfile in memory.
+		class TagfileBuilder {
+		public:
+			explicit TagfileBuilder(bool bigEndian);
+
+			struct Member {
+				const char *name;
+				int32_t type;
+				const char *className;
+				int32_t tupleSize;
+			};
+
+			void type(const char *name, int32_t parent, const std::vector<Member> &members);
+
+			void varInt(int32_t value);
+			void string(const std::string &text);
+			void real(float value);
+			void byte(uint8_t value);
+
+			std::vector<unsigned char> finish();
+
+		private:
+			bool m_bigEndian;
+			std::vector<unsigned char> m_data;
+			std::unordered_map<std::string, int32_t> m_strings;
+		};
+
+		/*
+		 * hkRootLevelContainer -> hkaAnimationContainer -> skeletons, with
+		 * bones, a reference pose and floats, and one hkSimpleLocalFrame
+		 * shared by all of the skeletons.
+		 */
+		std::vector<unsigned char> skeletonPackfile(size_t skeletonCount, size_t boneCount);
+
+		/*
+		 * count Node objects (derived from Base), linked through child, each
+		 * with nested structs, a Pair struct array and numeric arrays. Every
+		 * other node lacks its w member.
+		 */
+		std::vector<unsigned char> nodeTagfile(size_t count, bool bigEndian);
+
+		// Tagfile varint: a sign bit and six bits, then seven bits per byte.
+		void appendVarInt(std::vector<unsigned char> &target, int32_t value);
+
+		HKXMapping toMapping(const std::vector<unsigned char> &contents);
+
+		// Writes the contents to a temporary file, removed again by the destructor.
+		class TemporaryFile {
+		public:
+			TemporaryFile(const char *name, const std::vector<unsigned char> &contents);
+			~TemporaryFile();
+
+			TemporaryFile(const TemporaryFile &other) = delete;
+			TemporaryFile &operator =(const TemporaryFile &other) = delete;
+
+			inline const char *path() const { return m_path.c_str(); }
+
+		private:
+			std::string m_path;
+		};
+
+		// A string field, however it was loaded.
+		std::string_view text(const HKXVariant &value);
+
+		// Pretty-printed structure graph, with the structure addresses left out so that loads can be compared.
+		std::string dump(const HKXStructRef &root);
+
+		std::string load(const std::vector<unsigned char> &contents, const HKXLoadOptions &options = HKXLoadOptions());
+	}
+}
+
+#endif
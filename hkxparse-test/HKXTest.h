@@ -0,0 +1,57 @@
+#ifndef HKXPARSE_TEST_HKX_TEST_H
+#define HKXPARSE_TEST_HKX_TEST_H
+
+#include <string>
+#include <vector>
+
+namespace hkxparse {
+	namespace test {
+		using TestFunction = void (*)();
+
+		struct TestCase {
+			const char *name;
+			TestFunction function;
+		};
+
+		std::vector<TestCase> &testCases();
+
+		struct TestRegistration {
+			TestRegistration(const char *name, TestFunction function) {
+				testCases().push_back({ name, function });
+			}
+		};
+
+		// Thrown by the checks; deliberately not a std::exception, so that HKX_CHECK_THROWS never catches it.
+		struct TestFailure {
+			std::string message;
+		};
+
+		[[noreturn]] void fail(const char *file, int line, const std::string &message);
+	}
+}
+
+#define HKX_TEST(name) \
+	static void name(); \
+	static ::hkxparse::test::TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define HKX_CHECK(condition) \
+	do { \
+		if (!(condition)) \
+			::hkxparse::test::fail(__FILE__, __LINE__, "check failed: " #condition); \
+	} while (0)
+
+#define HKX_CHECK_THROWS(expression, exceptionType) \
+	do { \
+		bool thrown = false; \
+		try { \
+			expression; \
+		} \
+		catch (const exceptionType &) { \
+			thrown = true; \
+		} \
+		if (!thrown) \
+			::hkxparse::test::fail(__FILE__, __LINE__, "expected " #exceptionType " from " #expression); \
+	} while (0)
+
+#endif
@@ -0,0 +1,331 @@
+#include "HKXTest.h"
+#include "Fixtures.h"
+
+#include <hkxparse/HKXBatchLoader.h>
+#include <hkxparse/HKXFile.h>
+#include <hkxparse/HKXPackfileDecoder.h>
+#include <hkxparse/HavokPackfileLayouts.h>
+#include <hkxparse/HavokReflectionTypes.h>
+#include <hkxparse/PackfileTypes.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+
+using namespace hkxparse;
+using namespace hkxparse::test;
+
+static const size_t SkeletonCount = 3;
+static const size_t BoneCount = 5;
+
+static HKXStructRef animationContainer(const HKXStructRef &root) {
+	const auto &variants = std::get<HKXArray>(*root->field("namedVariants"));
+	HKX_CHECK(variants.values.size() == 1);
+
+	return std::get<HKXStructRef>(*std::get<HKXStruct>(variants.values[0]).field("variant"));
+}
+
+static std::vector<HKXStructRef> skeletons(const HKXStructRef &root) {
+	std::vector<HKXStructRef> result;
+
+	for (const auto &value : std::get<HKXArray>(*animationContainer(root)->field("skeletons")).values) {
+		result.push_back(std::get<HKXStructRef>(value));
+	}
+
+	return result;
+}
+
+static HKXLoadOptions fixupThreads(unsigned int fixupThreads, unsigned int decodeThreads) {
+	HKXLoadOptions options;
+	options.fixupThreads = fixupThreads;
+	options.decodeThreads = decodeThreads;
+	return options;
+}
+
+HKX_TEST(packfileLoadsSkeletons) {
+	HKXFile file;
+	file.loadFile(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	auto loaded = skeletons(file.root());
+	HKX_CHECK(loaded.size() == SkeletonCount);
+
+	for (size_t index = 0; index < SkeletonCount; index++) {
+		const auto &skeleton = loaded[index];
+
+		HKX_CHECK(text(*skeleton->field("name")) == "skeleton" + std::to_string(index));
+
+		const auto &bones = std::get<HKXArray>(*skeleton->field("bones")).values;
+		HKX_CHECK(bones.size() == BoneCount);
+		HKX_CHECK(text(*std::get<HKXStruct>(bones[2]).field("name")) == "bone" + std::to_string(index) + "_2");
+		HKX_CHECK(std::get<uint64_t>(*std::get<HKXStruct>(bones[3]).field("lockTranslation")) == 1);
+
+		const auto &referenceFloats = std::get<HKXRealArray>(*skeleton->field("referenceFloats"));
+		HKX_CHECK(referenceFloats.size() == 2 && referenceFloats[1] == 2.5f);
+	}
+
+	// The local frame is shared by all of the skeletons.
+	auto frame = [&](size_t index) {
+		const auto &frames = std::get<HKXArray>(*loaded[index]->field("localFrames")).values;
+		return std::get<HKXStructRef>(*std::get<HKXStruct>(frames[0]).field("localFrame"));
+	};
+
+	HKX_CHECK(frame(0) && frame(0) == frame(SkeletonCount - 1));
+}
+
+HKX_TEST(packfileFixupIndexMatchesPatching) {
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+	auto patched = load(contents);
+
+	// A read-only mapping cannot be patched, so the pointers are resolved through the fixup index.
+	TemporaryFile temporary("hkxparse-test-fixups.hkx", contents);
+
+	HKXFile file;
+	file.loadFile(HKXMapping(temporary.path(), HKXMapping::Access::ReadOnly));
+
+	HKX_CHECK(dump(file.root()) == patched);
+}
+
+HKX_TEST(packfileLazyMatchesEager) {
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+	auto eager = load(contents);
+
+	HKXLoadOptions options;
+	options.lazy = true;
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(contents));
+
+	auto container = animationContainer(file.root());
+	HKX_CHECK(!container.isMaterialized());
+
+	auto loaded = skeletons(file.root());
+	HKX_CHECK(container.isMaterialized());
+	HKX_CHECK(!loaded[1].isMaterialized());
+	HKX_CHECK(text(*loaded[1]->field("name")) == "skeleton1");
+	HKX_CHECK(loaded[1].isMaterialized());
+	HKX_CHECK(!loaded[2].isMaterialized());
+
+	HKX_CHECK(dump(file.root()) == eager);
+}
+
+HKX_TEST(packfileZeroCopyMatchesCopy) {
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+
+	HKXLoadOptions options;
+	options.zeroCopy = true;
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(contents));
+
+	auto skeleton = skeletons(file.root())[0];
+	HKX_CHECK(text(*skeleton->field("name")) == "skeleton0");
+	HKX_CHECK(std::get<HKXRealArray>(*skeleton->field("referenceFloats")).isView());
+
+	// Strings print alike either way.
+	HKX_CHECK(dump(file.root()) == load(contents));
+}
+
+HKX_TEST(packfileGeneratedDecodersMatchGenericPath) {
+	auto layout = PackfileBuilder::layout();
+	HKX_CHECK(HKXPackfileDecoder::findDecoders(layout) != nullptr);
+
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+
+	// Projecting every field keeps all of them, but takes every class off the generated decoders.
+	HKXLoadOptions options;
+
+	for (size_t index = 0; index < layout->classCount; index++) {
+		auto &fields = options.fieldProjections[layout->classes[index]->name];
+
+		for (auto classInChain = layout->classes[index]; classInChain; classInChain = classInChain->parent) {
+			for (size_t member = 0; member < classInChain->numDeclaredMembers; member++) {
+				fields.insert(classInChain->declaredMembers[member].name);
+			}
+		}
+	}
+
+	HKX_CHECK(load(contents, options) == load(contents));
+}
+
+HKX_TEST(packfileAllowListLoadsSkeletonThroughRoot) {
+	HKXLoadOptions options;
+	options.allowedClasses = { "hkRootLevelContainer", "hkaAnimationContainer", "hkaSkeleton" };
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	auto loaded = skeletons(file.root());
+	HKX_CHECK(loaded.size() == SkeletonCount);
+
+	// Bones are array elements, loaded with their skeleton.
+	const auto &bones = std::get<HKXArray>(*loaded[0]->field("bones")).values;
+	HKX_CHECK(bones.size() == BoneCount);
+	HKX_CHECK(text(*std::get<HKXStruct>(bones[4]).field("name")) == "bone0_4");
+
+	// The local frame is not on the list: it is there, but empty.
+	const auto &frames = std::get<HKXArray>(*loaded[0]->field("localFrames")).values;
+	auto frame = std::get<HKXStructRef>(*std::get<HKXStruct>(frames[0]).field("localFrame"));
+	HKX_CHECK(frame && frame->type);
+	HKX_CHECK(std::holds_alternative<std::monostate>(*frame->field("name")));
+}
+
+HKX_TEST(packfileAllowListWithoutContainerStopsAtRoot) {
+	HKXLoadOptions options;
+	options.allowedClasses = { "hkRootLevelContainer", "hkaSkeleton" };
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	auto container = animationContainer(file.root());
+	HKX_CHECK(container);
+	HKX_CHECK(std::holds_alternative<std::monostate>(*container->field("skeletons")));
+}
+
+HKX_TEST(packfileDenyList) {
+	HKXLoadOptions options;
+	options.deniedClasses = { "hkLocalFrame" };
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	auto skeleton = skeletons(file.root())[0];
+	HKX_CHECK(text(*skeleton->field("name")) == "skeleton0");
+
+	const auto &frames = std::get<HKXArray>(*skeleton->field("localFrames")).values;
+	auto frame = std::get<HKXStructRef>(*std::get<HKXStruct>(frames[0]).field("localFrame"));
+	HKX_CHECK(std::holds_alternative<std::monostate>(*frame->field("transform")));
+}
+
+HKX_TEST(packfileProjection) {
+	HKXLoadOptions options;
+	options.fieldProjections["hkaSkeleton"] = { "name", "bones" };
+	options.fieldProjections["hkaBone"] = { "name" };
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	auto skeleton = skeletons(file.root())[1];
+	HKX_CHECK(text(*skeleton->field("name")) == "skeleton1");
+	HKX_CHECK(std::holds_alternative<std::monostate>(*skeleton->field("referencePose")));
+	HKX_CHECK(std::holds_alternative<std::monostate>(*skeleton->field("localFrames")));
+
+	const auto &bone = std::get<HKXStruct>(std::get<HKXArray>(*skeleton->field("bones")).values[0]);
+	HKX_CHECK(text(*bone.field("name")) == "bone1_0");
+	HKX_CHECK(std::holds_alternative<std::monostate>(*bone.field("lockTranslation")));
+}
+
+HKX_TEST(packfileConcurrentLoadMatchesSingleThreaded) {
+	auto contents = skeletonPackfile(16, BoneCount);
+	auto single = load(contents);
+
+	HKX_CHECK(load(contents, fixupThreads(4, 1)) == single);
+	HKX_CHECK(load(contents, fixupThreads(1, 4)) == single);
+	HKX_CHECK(load(contents, fixupThreads(4, 4)) == single);
+	HKX_CHECK(load(contents, fixupThreads(0, 0)) == single);
+}
+
+HKX_TEST(packfileBatchMatchesSingleLoad) {
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+	auto single = load(contents);
+
+	HKXBatchLoader batch(fixupThreads(2, 2), 4);
+
+	std::vector<std::future<std::unique_ptr<HKXFile>>> files;
+	for (size_t index = 0; index < 8; index++) {
+		files.push_back(batch.load(toMapping(contents)));
+	}
+
+	for (auto &file : files) {
+		HKX_CHECK(dump(file.get()->root()) == single);
+	}
+}
+
+HKX_TEST(packfileBudgetedStepsMatchSingleStep) {
+	auto contents = skeletonPackfile(SkeletonCount, BoneCount);
+
+	HKXLoadBudget budget;
+	budget.bytes = 1;
+
+	HKXFile file;
+	file.beginLoad(toMapping(contents));
+
+	size_t steps = 0;
+	bool done = false;
+
+	while (!done) {
+		done = file.loadStep(budget);
+		steps++;
+
+		HKX_CHECK(done || (file.loading() && !file.root()));
+	}
+
+	HKX_CHECK(steps > 1);
+	HKX_CHECK(!file.loading());
+	HKX_CHECK(dump(file.root()) == load(contents));
+}
+
+HKX_TEST(packfileCancelledStepEndsLoad) {
+	HKXLoadBudget budget;
+	budget.bytes = 1;
+
+	std::atomic<bool> cancelled(false);
+	budget.cancelled = &cancelled;
+
+	HKXFile file;
+	file.beginLoad(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	HKX_CHECK(!file.loadStep(budget));
+	HKX_CHECK(file.loading());
+
+	cancelled = true;
+
+	HKX_CHECK(!file.loadStep(budget));
+	HKX_CHECK(!file.loading());
+	HKX_CHECK(!file.root());
+	HKX_CHECK_THROWS(file.loadStep(budget), std::logic_error);
+}
+
+HKX_TEST(packfileCancelledBeforeFirstStep) {
+	std::atomic<bool> cancelled(true);
+
+	HKXLoadBudget budget;
+	budget.cancelled = &cancelled;
+
+	HKXFile file;
+	file.beginLoad(toMapping(skeletonPackfile(SkeletonCount, BoneCount)));
+
+	HKX_CHECK(!file.loadStep(budget));
+	HKX_CHECK(!file.loading());
+	HKX_CHECK(!file.root());
+}
+
+template<typename Corrupt>
+static void checkCorruptHeader(Corrupt corrupt) {
+	auto contents = skeletonPackfile(1, 1);
+	corrupt(contents, reinterpret_cast<PackfileHeader *>(contents.data()));
+
+	HKXFile file;
+	HKX_CHECK_THROWS(file.loadFile(toMapping(contents)), std::runtime_error);
+	HKX_CHECK(!file.loading());
+}
+
+HKX_TEST(packfileCorruptHeadersThrow) {
+	checkCorruptHeader([](std::vector<unsigned char> &contents, PackfileHeader *) { contents.resize(sizeof(PackfileHeader) - 4); });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->fileVersion = 5; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->numSections = -1; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->numSections = 1000; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->contentsSectionIndex = 2; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->contentsClassNameSectionIndex = -1; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { header->contentsSectionOffset = 0x100000; });
+	checkCorruptHeader([](std::vector<unsigned char> &, PackfileHeader *header) { strcpy(header->contentsVersion, "hk_2099.1.0-r1"); });
+	checkCorruptHeader([](std::vector<unsigned char> &contents, PackfileHeader *) {
+		auto section = reinterpret_cast<PackfileSectionHeader *>(contents.data() + sizeof(PackfileHeader)) + 1;
+		section->endOffset = 0x100000;
+	});
+}
@@ -0,0 +1,175 @@
+#include "HKXTest.h"
+#include "Fixtures.h"
+
+#include <hkxparse/HKXFile.h>
+
+#include <atomic>
+#include <stdexcept>
+
+using namespace hkxparse;
+using namespace hkxparse::test;
+
+static const size_t NodeCount = 4;
+
+static int64_t intField(const HKXVariant &value) {
+	return static_cast<int64_t>(std::get<uint64_t>(value));
+}
+
+HKX_TEST(tagfileLoadsNodes) {
+	HKXFile file;
+	file.loadFile(toMapping(nodeTagfile(NodeCount, false)));
+
+	auto node = file.root();
+
+	for (size_t index = 0; index < NodeCount; index++) {
+		HKX_CHECK(node);
+		HKX_CHECK(text(*node->field("name")) == "node" + std::to_string(index));
+		HKX_CHECK(intField(*node->field("id")) == static_cast<int64_t>(index) * 7 - 3);
+		HKX_CHECK(intField(*node->field("extra")) == -static_cast<int64_t>(index));
+
+		// w is left out of the even nodes.
+		HKX_CHECK(std::holds_alternative<std::monostate>(*node->field("w")) == (index % 2 == 0));
+
+		const auto &ints = std::get<HKXIntArray>(*node->field("ints"));
+		HKX_CHECK(ints.size() == 5 && ints[4] == 400 - static_cast<int32_t>(index));
+
+		const auto &pair = std::get<HKXStruct>(*node->field("pair"));
+		HKX_CHECK(intField(*pair.field("a")) == static_cast<int64_t>(index));
+		HKX_CHECK(std::get<float>(*pair.field("b")) == index * 2.0f);
+
+		const auto &late = std::get<HKXStruct>(*node->field("late"));
+		HKX_CHECK(intField(*late.field("x")) == 42);
+		HKX_CHECK(std::get<HKXRealArray>(*late.field("reals")).size() == 5);
+		HKX_CHECK(std::get<HKXMatrix4Array>(*late.field("m4"))[1].v[3].w == -31.0f);
+
+		node = std::get<HKXStructRef>(*node->field("child"));
+	}
+
+	HKX_CHECK(!node);
+}
+
+HKX_TEST(tagfileStructArrayColumns) {
+	HKXFile file;
+	file.loadFile(toMapping(nodeTagfile(NodeCount, false)));
+
+	const auto &pairs = std::get<HKXStructArray>(*file.root()->field("pairs"));
+	HKX_CHECK(pairs.size() == 4);
+
+	const auto &a = std::get<HKXIntArray>(*pairs.column("a"));
+	const auto &b = std::get<HKXRealArray>(*pairs.column("b"));
+	HKX_CHECK(a.size() == 4 && b.size() == 4);
+
+	for (size_t index = 0; index < pairs.size(); index++) {
+		auto row = pairs.row(index);
+
+		HKX_CHECK(a[index] == static_cast<int32_t>(index) - 2);
+		HKX_CHECK(intField(row.field("a")) == static_cast<int64_t>(index) - 2);
+		HKX_CHECK(std::get<float>(row.field("b")) == index / 4.0f);
+
+		// A materialized row has the same fields as the struct it stands for.
+		auto materialized = row.materialize();
+		HKX_CHECK(materialized.type == pairs.type);
+		HKX_CHECK(intField(*materialized.field("a")) == static_cast<int64_t>(index) - 2);
+		HKX_CHECK(std::get<float>(*materialized.field("b")) == index / 4.0f);
+	}
+}
+
+HKX_TEST(tagfileBigEndianMatchesLittleEndian) {
+	HKX_CHECK(load(nodeTagfile(NodeCount, true)) == load(nodeTagfile(NodeCount, false)));
+}
+
+HKX_TEST(tagfileBudgetedStepsMatchSingleStep) {
+	auto contents = nodeTagfile(NodeCount, false);
+
+	HKXLoadBudget budget;
+	budget.bytes = 1;
+
+	HKXFile file;
+	file.beginLoad(toMapping(contents));
+
+	size_t steps = 0;
+	bool done = false;
+
+	while (!done) {
+		done = file.loadStep(budget);
+		steps++;
+
+		HKX_CHECK(done || (file.loading() && !file.root()));
+	}
+
+	HKX_CHECK(steps > 1);
+	HKX_CHECK(dump(file.root()) == load(contents));
+}
+
+HKX_TEST(tagfileCancelledStepEndsLoad) {
+	HKXLoadBudget budget;
+	budget.bytes = 1;
+
+	std::atomic<bool> cancelled(false);
+	budget.cancelled = &cancelled;
+
+	HKXFile file;
+	file.beginLoad(toMapping(nodeTagfile(NodeCount, false)));
+
+	HKX_CHECK(!file.loadStep(budget));
+	HKX_CHECK(file.loading());
+
+	cancelled = true;
+
+	HKX_CHECK(!file.loadStep(budget));
+	HKX_CHECK(!file.loading());
+	HKX_CHECK(!file.root());
+	HKX_CHECK_THROWS(file.loadStep(budget), std::logic_error);
+}
+
+HKX_TEST(tagfileClassFilter) {
+	auto contents = nodeTagfile(NodeCount, false);
+
+	// Node matches through its parent.
+	HKXLoadOptions allowed;
+	allowed.allowedClasses = { "Base" };
+	HKX_CHECK(load(contents, allowed) == load(contents));
+
+	HKXLoadOptions denied;
+	denied.deniedClasses = { "Node" };
+
+	HKXFile file;
+	file.setOptions(denied);
+	file.loadFile(toMapping(contents));
+
+	HKX_CHECK(file.root() && file.root()->type);
+	HKX_CHECK(std::holds_alternative<std::monostate>(*file.root()->field("name")));
+	HKX_CHECK(std::holds_alternative<std::monostate>(*file.root()->field("child")));
+}
+
+HKX_TEST(tagfileProjection) {
+	HKXLoadOptions options;
+	options.fieldProjections["Base"] = { "name", "pair", "pairs", "child" };
+	options.fieldProjections["Pair"] = { "a" };
+
+	HKXFile file;
+	file.setOptions(options);
+	file.loadFile(toMapping(nodeTagfile(NodeCount, false)));
+
+	auto second = std::get<HKXStructRef>(*file.root()->field("child"));
+	HKX_CHECK(text(*second->field("name")) == "node1");
+	HKX_CHECK(std::holds_alternative<std::monostate>(*second->field("id")));
+	HKX_CHECK(std::holds_alternative<std::monostate>(*second->field("late")));
+
+	const auto &pair = std::get<HKXStruct>(*second->field("pair"));
+	HKX_CHECK(intField(*pair.field("a")) == 1);
+	HKX_CHECK(std::holds_alternative<std::monostate>(*pair.field("b")));
+
+	const auto &pairs = std::get<HKXStructArray>(*second->field("pairs"));
+	HKX_CHECK(intField(pairs.row(3).field("a")) == 1);
+	HKX_CHECK(std::holds_alternative<std::monostate>(pairs.row(3).field("b")));
+}
+
+HKX_TEST(tagfileTruncatedThrows) {
+	auto contents = nodeTagfile(NodeCount, false);
+	contents.resize(contents.size() / 2);
+
+	HKXFile file;
+	HKX_CHECK_THROWS(file.loadFile(toMapping(contents)), std::runtime_error);
+	HKX_CHECK(!file.loading());
+}
@@ -1,20 +1,54 @@
-#include <hkxparse/HKXFile.h>
-#include <hkxparse/PrettyPrinter.h>
+#include "HKXTest.h"
 
-#include <fstream>
+#include <exception>
+#include <sstream>
+#include <stdio.h>
+#include <string.h>
 
+namespace hkxparse {
+	namespace test {
+		std::vector<TestCase> &testCases() {
+			static std::vector<TestCase> cases;
+			return cases;
+		}
+
+		void fail(const char *file, int line, const std::string &message) {
+			std::stringstream stream;
+			stream << file << ":" << line << ": " << message;
+			throw TestFailure{ stream.str() };
+		}
+	}
+}
+
+// Runs every test, or only those whose names contain the first argument.
 int main(int argc, char *argv[]) {
-	hkxparse::HKXFile file;
-	file.loadFile("C:\\projects\\havok\\eso.hkx"); // skeleton_tag
+	using namespace hkxparse::test;
 
-	{
-		std::ofstream stream;
-		stream.exceptions(std::ios::failbit | std::ios::eofbit | std::ios::badbit);
-		stream.open("C:\\projects\\hkxparse\\dump.txt", std::ios::out | std::ios::trunc);
+	const char *filter = argc > 1 ? argv[1] : nullptr;
+	size_t run = 0;
+	size_t failed = 0;
 
-		hkxparse::PrettyPrinter printer(stream);
-		printer.print(file.root());
+	for (const auto &testCase : testCases()) {
+		if (filter && !strstr(testCase.name, filter))
+			continue;
+
+		run++;
+
+		try {
+			testCase.function();
+			printf("ok     %s\n", testCase.name);
+		}
+		catch (const TestFailure &failure) {
+			failed++;
+			printf("FAILED %s\n       %s\n", testCase.name, failure.message.c_str());
+		}
+		catch (const std::exception &error) {
+			failed++;
+			printf("FAILED %s\n       unexpected exception: %s\n", testCase.name, error.what());
+		}
 	}
 
-	__debugbreak();
+	printf("%zu of %zu tests passed\n", run - failed, run);
+
+	return failed == 0 && run != 0 ? 0 : 1;
 }
@@ -1,268 +1,131 @@
 #include <hkxparse/Deserializer.h>
 
 #include <stdexcept>
+#include <string.h>
 
 namespace hkxparse {
-	Deserializer::Deserializer(const LayoutRules &layoutRules, const unsigned char *data, size_t dataSize) : m_layoutRules(layoutRules), m_ptr(data), m_end(data + dataSize), m_mark(data) {
-
-	}
-
-	Deserializer::Deserializer() : m_ptr(nullptr), m_end(nullptr), m_mark(nullptr) {
-
-	}
-
-	Deserializer::~Deserializer() {
-
-	}
-
-	Deserializer::Deserializer(Deserializer &&other) : m_ptr(nullptr), m_end(nullptr), m_mark(nullptr) {
-		*this = std::move(other);
-	}
-
-	Deserializer &Deserializer::operator =(Deserializer &&other) {
-		this->m_layoutRules = other.m_layoutRules;
-		std::swap(m_ptr, other.m_ptr);
-		std::swap(m_end, other.m_end);
-		std::swap(m_mark, other.m_mark);
-		return *this;
-	}
+	/*
+	 * Varints are little endian base 128, except that the first byte only
+	 * holds six bits of the magnitude, above the sign bit. Five bytes are
+	 * enough for any 32-bit value.
+	 */
+	static const size_t MaxVarIntLength = 5;
+
+	// Decodes a varint without bounds checks: at least MaxVarIntLength bytes must be readable.
+	// Returns nullptr for encodings longer than MaxVarIntLength.
+	static inline const unsigned char *decodeVarInt(const unsigned char *ptr, int32_t &result) {
+		uint32_t byte = *ptr++;
+		bool negative = byte & 1;
+		uint32_t value = (byte & 0x7E) >> 1;
 
-	void Deserializer::readBytes(unsigned char *target, size_t size) {
-		if (m_ptr + size > m_end) {
-			throw std::runtime_error("out of bounds read");
-		}
+		if (byte & 0x80) {
+			byte = *ptr++;
+			value |= (byte & 0x7F) << 6;
 
-		memcpy(target, m_ptr, size);
-		m_ptr += size;
-	}
+			if (byte & 0x80) {
+				byte = *ptr++;
+				value |= (byte & 0x7F) << 13;
 
+				if (byte & 0x80) {
+					byte = *ptr++;
+					value |= (byte & 0x7F) << 20;
 
-	void Deserializer::readBool(bool &val) {
-		uint32_t uval;
-		*this >> uval;
-		val = uval != 0;
-	}
+					if (byte & 0x80) {
+						byte = *ptr++;
+						value |= (byte & 0x7F) << 27;
 
-	void Deserializer::readPointer(uint64_t &val) {
-		if (m_layoutRules.bytesInPointer == 4) {
-			uint32_t proxy;
-			*this >> proxy;
-			val = proxy;
-		}
-		else if (m_layoutRules.bytesInPointer == 8) {
-			*this >> val;
-		}
-		else {
-			throw std::runtime_error("unsupported pointer length");
+						if (byte & 0x80)
+							return nullptr;
+					}
+				}
+			}
 		}
-	}
-
-	Deserializer &Deserializer::operator >>(char &value) {
-		union {
-			char val;
-			unsigned char bytes[1];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		value = u.val;
-
-		return *this;
-	}
-	Deserializer &Deserializer::operator >>(int8_t &value) {
-		union {
-			int8_t val;
-			unsigned char bytes[1];
-		} u;
 
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		value = u.val;
-
-		return *this;
-	}
-
-	Deserializer &Deserializer::operator >>(uint8_t &value) {
-		union {
-			uint8_t val;
-			unsigned char bytes[1];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		value = u.val;
-
-		return *this;
-	}
-
-	Deserializer &Deserializer::operator >>(int16_t &value) {
-		union {
-			int16_t val;
-			unsigned char bytes[2];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
+		if (negative) {
+			result = -static_cast<int32_t>(value);
 		}
 		else {
-			value = _byteswap_ushort(u.val);
+			result = static_cast<int32_t>(value);
 		}
 
-		return *this;
+		return ptr;
 	}
 
-	Deserializer &Deserializer::operator >>(uint16_t &value) {
-		union {
-			uint16_t val;
-			unsigned char bytes[2];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
-		}
-		else {
-			value = _byteswap_ushort(u.val);
-		}
-
-		return *this;
+	void throwDeserializerError(const char *message) {
+		throw std::runtime_error(message);
 	}
 
-	Deserializer &Deserializer::operator >>(int32_t &value) {
-		union {
-			int32_t val;
-			unsigned char bytes[4];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
-		}
-		else {
-			value = _byteswap_ulong(u.val);
+	static int32_t readVarIntChecked(const unsigned char *&ptr, const unsigned char *end) {
+		if (ptr == end) {
+			throwDeserializerError("out of bounds read");
 		}
 
-		return *this;
-	}
-
-
-	Deserializer &Deserializer::operator >>(uint32_t &value) {
-		union {
-			uint32_t val;
-			unsigned char bytes[4];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
-		}
-		else {
-			value = _byteswap_ulong(u.val);
-		}
-
-		return *this;
-	}
-
-
-	Deserializer &Deserializer::operator >>(int64_t &value) {
-		union {
-			int64_t val;
-			unsigned char bytes[4];
-		} u;
+		uint32_t byte = *ptr++;
+		bool negative = byte & 1;
+		uint32_t value = (byte & 0x7E) >> 1;
+		size_t pos = 6;
 
-		readBytes(u.bytes, sizeof(u.bytes));
+		while (byte & 0x80) {
+			if (ptr == end) {
+				throwDeserializerError("out of bounds read");
+			}
 
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
-		}
-		else {
-			value = _byteswap_uint64(u.val);
+			byte = *ptr++;
+			value |= (byte & 0x7F) << pos;
+			pos += 7;
 		}
 
-		return *this;
-	}
-
-	Deserializer &Deserializer::operator >>(uint64_t &value) {
-		union {
-			uint64_t val;
-			unsigned char bytes[4];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (m_layoutRules.littleEndian) {
-			value = u.val;
+		if (negative) {
+			return -static_cast<int32_t>(value);
 		}
 		else {
-			value = _byteswap_uint64(u.val);
-		}
-
-		return *this;
-	}
-
-
-	Deserializer &Deserializer::operator >>(float &val) {
-		union {
-			uint32_t val;
-			float f;
-			unsigned char bytes[4];
-		} u;
-
-		readBytes(u.bytes, sizeof(u.bytes));
-
-		if (!m_layoutRules.littleEndian) {
-			u.val = _byteswap_ulong(u.val);
+			return static_cast<int32_t>(value);
 		}
-
-		val = u.f;
-
-		return *this;
-	}
-
-	void Deserializer::mark() {
-		m_mark = m_ptr;
 	}
 
-	void Deserializer::seekFromMark(size_t offset) {
-		auto target = m_mark + offset;
-		if (target > m_end) {
-			throw std::runtime_error("seek is out of range");
+	int32_t readVarInt(const unsigned char *&ptr, const unsigned char *end) {
+		if (static_cast<size_t>(end - ptr) >= MaxVarIntLength) {
+			int32_t value;
+			auto next = decodeVarInt(ptr, value);
+			if (next) {
+				ptr = next;
+				return value;
+			}
 		}
 
-		m_ptr = target;
+		return readVarIntChecked(ptr, end);
 	}
 
-	uint8_t Deserializer::readByte() {
-		if (m_ptr == m_end) {
-			throw std::runtime_error("out of bounds read");
-		}
+	void readVarInts(const unsigned char *&ptr, const unsigned char *end, int32_t *target, size_t count) {
+		auto targetEnd = target + count;
 
-		return *m_ptr++;
-	}
+		while (target != targetEnd) {
+			// Runs of eight single byte varints are decoded at once.
+			if (targetEnd - target >= 8 && end - ptr >= 8 && !(*ptr & 0x80)) {
+				uint64_t bytes;
+				memcpy(&bytes, ptr, sizeof(bytes));
 
-	int32_t Deserializer::readVarInt() {
-		auto byte = readByte();
-		bool negative = byte & 1;
-		uint32_t value = (byte & 0x7E) >> 1;
-		size_t pos = 6;
+				if ((bytes & 0x8080808080808080ULL) == 0) {
+					for (size_t index = 0; index < 8; index++) {
+						int32_t byte = ptr[index];
+						int32_t sign = byte & 1;
+						target[index] = ((byte >> 1) ^ -sign) + sign;
+					}
 
-		while (byte & 0x80) {
-			byte = readByte();
-			value |= (byte & 0x7F) << pos;
-			pos += 7;
-		}
+					target += 8;
+					ptr += 8;
+					continue;
+				}
+			}
 
-		if (negative) {
-			return -static_cast<int32_t>(value);
-		}
-		else {
-			return static_cast<int32_t>(value);
+			const unsigned char *next;
+			if (static_cast<size_t>(end - ptr) >= MaxVarIntLength && (next = decodeVarInt(ptr, *target)) != nullptr) {
+				ptr = next;
+				target++;
+			}
+			else {
+				*target++ = readVarIntChecked(ptr, end);
+			}
 		}
 	}
-
 }
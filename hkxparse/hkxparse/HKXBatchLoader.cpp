@@ -0,0 +1,219 @@
+#include <hkxparse/HKXBatchLoader.h>
+
+#include <algorithm>
+
+namespace hkxparse {
+	// The batch loader and the worker index of the calling thread, if it is a worker
+	static thread_local const HKXBatchLoader *currentLoader = nullptr;
+	static thread_local size_t currentWorker = 0;
+
+	HKXBatchLoader::HKXBatchLoader(const HKXLoadOptions &options, unsigned int threads) : m_options(options), m_queued(0), m_unfinished(0), m_nextQueue(0), m_stopping(false) {
+		if (threads == 0) {
+			threads = std::max(1U, std::thread::hardware_concurrency());
+		}
+
+		if (!m_options.executor) {
+			m_options.executor = this;
+		}
+
+		for (unsigned int index = 0; index < threads; index++) {
+			m_queues.emplace_back(std::make_unique<WorkerQueue>());
+		}
+
+		m_workers.reserve(threads);
+
+		for (unsigned int index = 0; index < threads; index++) {
+			m_workers.emplace_back(&HKXBatchLoader::workerMain, this, index);
+		}
+	}
+
+	HKXBatchLoader::~HKXBatchLoader() {
+		wait();
+
+		{
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_stopping = true;
+		}
+
+		m_jobQueued.notify_all();
+
+		for (auto &worker : m_workers) {
+			worker.join();
+		}
+	}
+
+	std::future<std::unique_ptr<HKXFile>> HKXBatchLoader::load(const std::string &filename) {
+		auto promise = std::make_shared<std::promise<std::unique_ptr<HKXFile>>>();
+		auto future = promise->get_future();
+
+		submit([this, promise, filename]() {
+			try {
+				promise->set_value(loadFile(filename));
+			}
+			catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+
+		return future;
+	}
+
+	std::future<std::unique_ptr<HKXFile>> HKXBatchLoader::load(HKXMapping &&mapping) {
+		auto promise = std::make_shared<std::promise<std::unique_ptr<HKXFile>>>();
+		auto future = promise->get_future();
+
+		// Jobs have to be copyable, and the mapping is not.
+		auto sharedMapping = std::make_shared<HKXMapping>(std::move(mapping));
+
+		submit([this, promise, sharedMapping]() {
+			try {
+				promise->set_value(loadFile(std::move(*sharedMapping)));
+			}
+			catch (...) {
+				promise->set_exception(std::current_exception());
+			}
+		});
+
+		return future;
+	}
+
+	void HKXBatchLoader::load(const std::vector<std::string> &filenames, const Callback &callback) {
+		for (size_t index = 0; index < filenames.size(); index++) {
+			submit([this, index, filename = filenames[index], callback]() {
+				std::unique_ptr<HKXFile> file;
+				std::exception_ptr error;
+
+				try {
+					file = loadFile(filename);
+				}
+				catch (...) {
+					error = std::current_exception();
+				}
+
+				callback(index, std::move(file), error);
+			});
+		}
+	}
+
+	unsigned int HKXBatchLoader::concurrency() const {
+		return threadCount();
+	}
+
+	void HKXBatchLoader::execute(std::function<void()> &&job) {
+		submit(std::move(job));
+	}
+
+	void HKXBatchLoader::wait() {
+		std::unique_lock<std::mutex> locker(m_mutex);
+
+		m_allDone.wait(locker, [this]() { return m_unfinished == 0; });
+	}
+
+	std::unique_ptr<HKXFile> HKXBatchLoader::loadFile(const std::string &filename) const {
+		auto file = std::make_unique<HKXFile>();
+		file->setOptions(m_options);
+		file->loadFile(filename.c_str());
+
+		return file;
+	}
+
+	std::unique_ptr<HKXFile> HKXBatchLoader::loadFile(HKXMapping &&mapping) const {
+		auto file = std::make_unique<HKXFile>();
+		file->setOptions(m_options);
+		file->loadFile(std::move(mapping));
+
+		return file;
+	}
+
+	void HKXBatchLoader::submit(Job &&job) {
+		size_t queue;
+
+		if (currentLoader == this) {
+			queue = currentWorker;
+		}
+		else {
+			std::unique_lock<std::mutex> locker(m_mutex);
+			queue = m_nextQueue;
+			m_nextQueue = (m_nextQueue + 1) % m_queues.size();
+		}
+
+		{
+			auto &target = *m_queues[queue];
+			std::unique_lock<std::mutex> locker(target.mutex);
+			target.jobs.emplace_back(std::move(job));
+		}
+
+		// Counted only once it is in a queue, so that a worker that claims it is sure to find it.
+		{
+			std::unique_lock<std::mutex> locker(m_mutex);
+			m_queued++;
+			m_unfinished++;
+		}
+
+		m_jobQueued.notify_one();
+	}
+
+	/*
+	 * Takes the newest job from the worker's own queue, or else the oldest
+	 * one from the first other queue that has any.
+	 */
+	bool HKXBatchLoader::takeJob(size_t worker, Job &job) {
+		{
+			auto &own = *m_queues[worker];
+			std::unique_lock<std::mutex> locker(own.mutex);
+			if (!own.jobs.empty()) {
+				job = std::move(own.jobs.back());
+				own.jobs.pop_back();
+				return true;
+			}
+		}
+
+		for (size_t offset = 1; offset < m_queues.size(); offset++) {
+			auto &victim = *m_queues[(worker + offset) % m_queues.size()];
+			std::unique_lock<std::mutex> locker(victim.mutex);
+			if (!victim.jobs.empty()) {
+				job = std::move(victim.jobs.front());
+				victim.jobs.pop_front();
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void HKXBatchLoader::workerMain(size_t worker) {
+		currentLoader = this;
+		currentWorker = worker;
+
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> locker(m_mutex);
+				m_jobQueued.wait(locker, [this]() { return m_queued != 0 || m_stopping; });
+
+				if (m_queued == 0)
+					return;
+
+				m_queued--;
+			}
+
+			// A job has been claimed, but another worker may be just taking the one that was seen.
+			Job job;
+			while (!takeJob(worker, job)) {
+				std::this_thread::yield();
+			}
+
+			job();
+			job = nullptr;
+
+			bool allDone;
+			{
+				std::unique_lock<std::mutex> locker(m_mutex);
+				allDone = --m_unfinished == 0;
+			}
+
+			if (allDone) {
+				m_allDone.notify_all();
+			}
+		}
+	}
+}
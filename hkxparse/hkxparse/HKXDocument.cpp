@@ -0,0 +1,67 @@
+#include <hkxparse/HKXDocument.h>
+
+namespace hkxparse {
+	// Innermost ThreadArena of the calling thread
+	static thread_local HKXDocument::ThreadArena *currentThreadArena = nullptr;
+
+	HKXDocument::HKXDocument(HKXMapping &&mapping) : m_mapping(std::move(mapping)), m_arena(*this) {
+
+	}
+
+	HKXDocument::~HKXDocument() {
+
+	}
+
+	HKXStructRef HKXDocument::allocateStruct() {
+		auto storage = m_arena.allocate(sizeof(HKXStruct), alignof(HKXStruct));
+
+		return HKXStructRef(new(storage) HKXStruct(allocator()));
+	}
+
+	HKXLazyState *HKXDocument::allocateLazyState(HKXStructLoader *loader, uint64_t offset, const void *typeInfo) {
+		auto storage = m_arena.allocate(sizeof(HKXLazyState), alignof(HKXLazyState));
+
+		return new(storage) HKXLazyState(loader, offset, typeInfo);
+	}
+
+	void HKXDocument::retainLoader(std::unique_ptr<HKXStructLoader> &&loader) {
+		m_loader = std::move(loader);
+	}
+
+	HKXDocument::ThreadArena::ThreadArena(HKXDocument &document) : m_document(&document), m_previous(currentThreadArena) {
+		auto arena = std::make_unique<std::pmr::monotonic_buffer_resource>(ArenaBlockSize, std::pmr::new_delete_resource());
+		m_arena = arena.get();
+
+		{
+			std::unique_lock<std::mutex> locker(document.m_threadArenasMutex);
+			document.m_threadArenas.emplace_back(std::move(arena));
+		}
+
+		currentThreadArena = this;
+	}
+
+	HKXDocument::ThreadArena::~ThreadArena() {
+		currentThreadArena = m_previous;
+	}
+
+	HKXDocument::Arena::Arena(HKXDocument &document) : m_document(document), m_shared(ArenaBlockSize, std::pmr::new_delete_resource()) {
+
+	}
+
+	void *HKXDocument::Arena::do_allocate(size_t bytes, size_t alignment) {
+		auto threadArena = currentThreadArena;
+		if (threadArena && threadArena->m_document == &m_document) {
+			return threadArena->m_arena->allocate(bytes, alignment);
+		}
+
+		return m_shared.allocate(bytes, alignment);
+	}
+
+	void HKXDocument::Arena::do_deallocate(void *, size_t, size_t) {
+		// Released as a whole with the document.
+	}
+
+	bool HKXDocument::Arena::do_is_equal(const std::pmr::memory_resource &other) const noexcept {
+		return this == &other;
+	}
+}
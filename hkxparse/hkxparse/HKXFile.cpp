@@ -1,13 +1,15 @@
 #include <hkxparse/HKXFile.h>
+#include <hkxparse/HKXDocument.h>
 #include <hkxparse/PackfileTypes.h>
 #include <hkxparse/HKXPackfileLoader.h>
 #include <hkxparse/TagfileTypes.h>
 #include <hkxparse/HKXTagfileParser.h>
 
-#include <fstream>
+#include <istream>
+#include <stdexcept>
 
 namespace hkxparse {
-	HKXFile::HKXFile() {
+	HKXFile::HKXFile() : m_packfilePending(false) {
 
 	}
 
@@ -16,18 +18,16 @@ namespace hkxparse {
 	}
 
 	void HKXFile::loadFile(const char *filename) {
-		std::ifstream stream;
-		stream.exceptions(std::ios::badbit | std::ios::failbit | std::ios::eofbit);
-		stream.open(filename, std::ios::in | std::ios::binary);
-		loadFile(stream);
+		beginLoad(filename);
+		loadStep();
 	}
 
+#ifdef _WIN32
 	void HKXFile::loadFile(const wchar_t *filename) {
-		std::ifstream stream;
-		stream.exceptions(std::ios::badbit | std::ios::failbit | std::ios::eofbit);
-		stream.open(filename, std::ios::in | std::ios::binary);
-		loadFile(stream);
+		beginLoad(filename);
+		loadStep();
 	}
+#endif
 
 	void HKXFile::loadFile(std::istream &stream) {
 		stream.seekg(0, std::ios::end);
@@ -44,40 +44,116 @@ namespace hkxparse {
 	}
 
 	void HKXFile::loadFile(HKXMapping &&mapping) {
-		m_mapping = std::move(mapping);
-		doLoadFile();
+		beginLoad(std::move(mapping));
+		loadStep();
 	}
 
-	void HKXFile::doLoadFile() {
-		if (m_mapping.size() >= sizeof(PackfileHeader)) {
-			const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
-			if (header.magic0 == PackfileMagic0 && header.magic1 == PackfileMagic1) {
-				parsePackfile();
-				return;
+	void HKXFile::beginLoad(const char *filename) {
+		beginLoad(HKXMapping(filename, HKXMapping::Access::CopyOnWrite));
+	}
+
+#ifdef _WIN32
+	void HKXFile::beginLoad(const wchar_t *filename) {
+		beginLoad(HKXMapping(filename, HKXMapping::Access::CopyOnWrite));
+	}
+#endif
+
+	void HKXFile::beginLoad(HKXMapping &&mapping) {
+		cancelLoad();
+
+		m_document = std::make_unique<HKXDocument>(std::move(mapping));
+
+		try {
+			const auto &contents = m_document->mapping();
+
+			if (contents.size() >= sizeof(PackfileHeader)) {
+				const auto &header = *reinterpret_cast<PackfileHeader *>(contents.data());
+				if (header.magic0 == PackfileMagic0 && header.magic1 == PackfileMagic1) {
+					// The fixups are applied by the first step.
+					m_packfilePending = true;
+					return;
+				}
 			}
+
+			if (contents.size() >= sizeof(TagfileHeader)) {
+				const auto &header = *reinterpret_cast<TagfileHeader *>(contents.data());
+				if ((header.magic0 == TagfileMagic0 && header.magic1 == TagfileMagic1) ||
+					(header.magic0 == _byteswap_ulong(TagfileMagic0) && header.magic1 == _byteswap_ulong(TagfileMagic1))) {
+
+					m_tagfileParser = std::make_unique<HKXTagfileParser>(m_document->mapping(), *m_document, m_options);
+					return;
+				}
+			}
+
+			throw std::runtime_error("hkx container not identified");
+		}
+		catch (...) {
+			cancelLoad();
+			throw;
 		}
+	}
+
+	bool HKXFile::loadStep(const HKXLoadBudget &budget) {
+		if (!loading())
+			throw std::logic_error("no load is in progress");
 
-		if (m_mapping.size() >= sizeof(TagfileHeader)) {
-			const auto &header = *reinterpret_cast<TagfileHeader *>(m_mapping.data());
-			if ((header.magic0 == TagfileMagic0 && header.magic1 == TagfileMagic1) ||
-				(header.magic0 == _byteswap_ulong(TagfileMagic0) && header.magic1 == _byteswap_ulong(TagfileMagic1))) {
+		if (budget.cancelled && budget.cancelled->load(std::memory_order_relaxed)) {
+			cancelLoad();
+			return false;
+		}
 
-				parseTagfile();
-				return;
+		bool done;
+
+		try {
+			if (m_packfilePending) {
+				m_packfilePending = false;
+				m_packfileLoader = std::make_unique<HKXPackfileLoader>(m_document->mapping(), *m_document, m_options);
+				m_packfileLoader->beginLoad();
+			}
+
+			if (m_packfileLoader) {
+				done = m_packfileLoader->loadStep(budget);
+			}
+			else {
+				done = m_tagfileParser->parseStep(budget);
 			}
 		}
+		catch (...) {
+			cancelLoad();
+			throw;
+		}
 
-		throw std::runtime_error("hkx container not identified");
-	}
+		if (done) {
+			finishLoad();
+		}
+		else if (budget.cancelled && budget.cancelled->load(std::memory_order_relaxed)) {
+			cancelLoad();
+		}
 
-	void HKXFile::parsePackfile() {
-		HKXPackfileLoader loader(m_mapping);
-		m_root = loader.loadRoot();
+		return done;
 	}
 
-	void HKXFile::parseTagfile() {
-		HKXTagfileParser parser(m_mapping);
-		m_root = parser.parse();		
+	void HKXFile::cancelLoad() {
+		m_root = HKXStructRef();
+		m_packfilePending = false;
+		m_packfileLoader.reset();
+		m_tagfileParser.reset();
+		m_document.reset();
 	}
 
+	void HKXFile::finishLoad() {
+		if (m_packfileLoader) {
+			m_root = m_packfileLoader->root();
+
+			if (m_options.lazy) {
+				m_document->retainLoader(std::move(m_packfileLoader));
+			}
+
+			m_packfileLoader.reset();
+		}
+		else {
+			m_root = m_tagfileParser->root();
+			m_tagfileParser.reset();
+		}
+	}
 }
@@ -0,0 +1,71 @@
+#include <hkxparse/HKXLoadFilter.h>
+#include <hkxparse/HKXTypeRegistry.h>
+
+#include <mutex>
+
+namespace hkxparse {
+	HKXLoadFilter::HKXLoadFilter(const HKXLoadOptions &options) : m_options(options),
+		m_active(!options.allowedClasses.empty() || !options.deniedClasses.empty() || !options.fieldProjections.empty()) {
+
+	}
+
+	HKXLoadFilter::~HKXLoadFilter() {
+
+	}
+
+	const std::vector<bool> *HKXLoadFilter::fieldMask(const HKXTypeDescriptor *type) {
+		if (!m_active)
+			return nullptr;
+
+		const auto &mask = decision(type).mask;
+		return mask.empty() ? nullptr : &mask;
+	}
+
+	const HKXLoadFilter::Decision &HKXLoadFilter::decision(const HKXTypeDescriptor *type) {
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			auto it = m_decisions.find(type);
+			if (it != m_decisions.end())
+				return it->second;
+		}
+
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+		auto it = m_decisions.find(type);
+		if (it != m_decisions.end())
+			return it->second;
+
+		Decision decision;
+		decision.allowed = classAllowed(type);
+
+		for (auto classIt = type->classNames.rbegin(); classIt != type->classNames.rend(); classIt++) {
+			auto projection = m_options.fieldProjections.find(classIt->c_str());
+			if (projection != m_options.fieldProjections.end()) {
+				decision.mask.reserve(type->fieldCount());
+
+				for (const auto &field : type->fieldNames) {
+					decision.mask.push_back(projection->second.count(field.c_str()) != 0);
+				}
+
+				break;
+			}
+		}
+
+		return m_decisions.emplace(type, std::move(decision)).first->second;
+	}
+
+	bool HKXLoadFilter::classAllowed(const HKXTypeDescriptor *type) const {
+		bool allowed = m_options.allowedClasses.empty();
+
+		for (const auto &name : type->classNames) {
+			if (m_options.deniedClasses.count(name.c_str()) != 0)
+				return false;
+
+			if (m_options.allowedClasses.count(name.c_str()) != 0)
+				allowed = true;
+		}
+
+		return allowed;
+	}
+}
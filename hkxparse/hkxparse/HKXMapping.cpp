@@ -1,21 +1,118 @@
 #include <hkxparse/HKXMapping.h>
 
 #include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 namespace hkxparse {
-	HKXMapping::HKXMapping() noexcept : m_size(0), m_mapping(nullptr) {
+#ifdef _WIN32
+	static unsigned char *mapFileHandle(HANDLE file, HKXMapping::Access access, size_t &size) {
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize)) {
+			CloseHandle(file);
+			throw std::runtime_error("GetFileSizeEx failed");
+		}
+
+		size = static_cast<size_t>(fileSize.QuadPart);
+		if (size == 0) {
+			CloseHandle(file);
+			return nullptr;
+		}
+
+		auto section = CreateFileMappingW(file, nullptr, access == HKXMapping::Access::ReadOnly ? PAGE_READONLY : PAGE_WRITECOPY, 0, 0, nullptr);
+		CloseHandle(file);
+
+		if (!section) {
+			throw std::runtime_error("CreateFileMapping failed");
+		}
+
+		auto view = MapViewOfFile(section, access == HKXMapping::Access::ReadOnly ? FILE_MAP_READ : FILE_MAP_COPY, 0, 0, 0);
+		CloseHandle(section);
+
+		if (!view) {
+			throw std::runtime_error("MapViewOfFile failed");
+		}
+
+		return static_cast<unsigned char *>(view);
+	}
+#endif
+
+	HKXMapping::HKXMapping() noexcept : m_size(0), m_mapping(nullptr), m_fileMapping(false), m_access(Access::CopyOnWrite) {
+
+	}
+
+	HKXMapping::HKXMapping(size_t size) : m_size(size), m_mapping(new unsigned char[size]), m_fileMapping(false), m_access(Access::CopyOnWrite) {
 
 	}
 
-	HKXMapping::HKXMapping(size_t size) : m_size(size), m_mapping(new unsigned char[size]) {
+	HKXMapping::HKXMapping(const char *filename, Access access) : m_size(0), m_mapping(nullptr), m_fileMapping(true), m_access(access) {
+#ifdef _WIN32
+		auto file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("unable to open " + std::string(filename));
+		}
 
+		m_mapping = mapFileHandle(file, access, m_size);
+#else
+		auto fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			throw std::runtime_error("unable to open " + std::string(filename));
+		}
+
+		struct stat st;
+		if (fstat(fd, &st) < 0) {
+			close(fd);
+			throw std::runtime_error("fstat failed on " + std::string(filename));
+		}
+
+		m_size = static_cast<size_t>(st.st_size);
+
+		if (m_size != 0) {
+			int protection = PROT_READ;
+			if (access != Access::ReadOnly) {
+				protection |= PROT_WRITE;
+			}
+
+			auto view = mmap(nullptr, m_size, protection, MAP_PRIVATE, fd, 0);
+			if (view == MAP_FAILED) {
+				close(fd);
+				throw std::runtime_error("unable to map " + std::string(filename));
+			}
+
+			m_mapping = static_cast<unsigned char *>(view);
+		}
+
+		close(fd);
+#endif
 	}
 
+#ifdef _WIN32
+	HKXMapping::HKXMapping(const wchar_t *filename, Access access) : m_size(0), m_mapping(nullptr), m_fileMapping(true), m_access(access) {
+		auto file = CreateFileW(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE) {
+			throw std::runtime_error("unable to open file");
+		}
+
+		m_mapping = mapFileHandle(file, access, m_size);
+	}
+#endif
+
 	HKXMapping::~HKXMapping() {
-		delete[] m_mapping;
+		release();
 	}
 
-	HKXMapping::HKXMapping(HKXMapping &&other) noexcept : m_size(0), m_mapping(nullptr) {
+	HKXMapping::HKXMapping(HKXMapping &&other) noexcept : m_size(0), m_mapping(nullptr), m_fileMapping(false), m_access(Access::CopyOnWrite) {
 		swap(other);
 	}
 
@@ -28,5 +125,23 @@ namespace hkxparse {
 	void HKXMapping::swap(HKXMapping &other) noexcept {
 		std::swap(m_size, other.m_size);
 		std::swap(m_mapping, other.m_mapping);
+		std::swap(m_fileMapping, other.m_fileMapping);
+		std::swap(m_access, other.m_access);
+	}
+
+	void HKXMapping::release() noexcept {
+		if (!m_fileMapping) {
+			delete[] m_mapping;
+		}
+		else if (m_mapping) {
+#ifdef _WIN32
+			UnmapViewOfFile(m_mapping);
+#else
+			munmap(m_mapping, m_size);
+#endif
+		}
+
+		m_mapping = nullptr;
+		m_size = 0;
 	}
-}
\ No newline at end of file
+}
@@ -0,0 +1,119 @@
+#include <hkxparse/HKXPackfileClassCache.h>
+#include <hkxparse/HKXPackfileDecoder.h>
+#include <hkxparse/HKXTypeRegistry.h>
+#include <hkxparse/HKXTrace.h>
+#include <hkxparse/HavokPackfileLayouts.h>
+
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sstream>
+
+namespace hkxparse {
+	HKXPackfileClassCache &HKXPackfileClassCache::forLayout(const HavokPackfileLayout *layout) {
+		static std::mutex mutex;
+		static std::unordered_map<const HavokPackfileLayout *, std::unique_ptr<HKXPackfileClassCache>> caches;
+
+		std::unique_lock<std::mutex> locker(mutex);
+
+		auto &cache = caches[layout];
+		if (!cache) {
+			cache.reset(new HKXPackfileClassCache(layout));
+		}
+
+		return *cache;
+	}
+
+	HKXPackfileClassCache::HKXPackfileClassCache(const HavokPackfileLayout *layout) : m_layout(layout), m_decoders(HKXPackfileDecoder::findDecoders(layout)) {
+
+	}
+
+	const HavokClass *HKXPackfileClassCache::findClass(const char *className) const {
+		auto index = findClassIndex(m_layout, className);
+		if (index < 0) {
+			std::stringstream error;
+			error << "No definition for class " << className;
+			throw std::runtime_error(error.str());
+		}
+
+		return m_layout->classes[index];
+	}
+
+	const HKXPackfileClassCache::ClassInfo &HKXPackfileClassCache::classInfo(const HavokClass *classReflection) {
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			auto it = m_classInfo.find(classReflection);
+			if (it != m_classInfo.end())
+				return it->second;
+		}
+
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+		return buildClassInfo(classReflection);
+	}
+
+	const HKXPackfileClassCache::ClassInfo &HKXPackfileClassCache::buildClassInfo(const HavokClass *classReflection) {
+		auto it = m_classInfo.find(classReflection);
+		if (it != m_classInfo.end())
+			return it->second;
+
+		auto &registry = HKXTypeRegistry::instance();
+
+		std::vector<const HavokClass *> chain;
+		for (auto classInChain = classReflection; classInChain; classInChain = classInChain->parent) {
+			chain.push_back(classInChain);
+		}
+
+		std::vector<HKXSymbol> classNames;
+		std::vector<HKXSymbol> fieldNames;
+
+		ClassInfo info;
+
+		for (auto chainIt = chain.rbegin(); chainIt != chain.rend(); chainIt++) {
+			auto classInChain = *chainIt;
+
+			classNames.push_back(registry.intern(classInChain->name));
+
+			for (size_t memberIndex = 0; memberIndex < classInChain->numDeclaredMembers; memberIndex++) {
+				auto &member = classInChain->declaredMembers[memberIndex];
+
+				if (!(member.flags & 1024)) {
+					fieldNames.push_back(registry.intern(member.name));
+
+					PlanMember entry;
+					entry.member = &member;
+					entry.nested = member.type == HavokType::Struct ? &buildClassInfo(member.typeClass) : nullptr;
+					info.plan.push_back(entry);
+				}
+			}
+		}
+
+		info.reflection = classReflection;
+		info.descriptor = registry.internType(classNames, fieldNames);
+		info.decode = nullptr;
+		info.mayHaveVtable = classMayHaveVtable(classReflection);
+
+		if (m_decoders) {
+			auto index = findClassIndex(m_layout, classReflection->name);
+
+			if (index >= 0 && m_layout->classes[index] == classReflection) {
+				info.decode = m_decoders[index];
+			}
+		}
+
+		return m_classInfo.emplace(classReflection, std::move(info)).first->second;
+	}
+
+	bool HKXPackfileClassCache::classMayHaveVtable(const HavokClass *classReflection) const {
+		auto index = findTypeInfoIndex(m_layout, classReflection->name);
+		if (index < 0)
+			return true;
+
+		auto typeInfo = m_layout->typeInfos[index];
+
+		HKX_TRACE("vtable for %s is %08llX\n", classReflection->name, typeInfo->vtable);
+
+		return typeInfo->vtable != 0;
+	}
+}
@@ -0,0 +1,34 @@
+#include <hkxparse/HKXPackfileDecoder.h>
+#include <hkxparse/Deserializer.h>
+#include <hkxparse/HavokPackfileLayouts.h>
+#include <hk_2010.2.0-r1_1-0-1-4.h>
+#include <hk_2010.2.0-r1_1-0-1-4_decoders.h>
+
+namespace hkxparse {
+	static const struct {
+		const HavokClass *const *classes;
+		const HKXPackfileDecoder::Function *functions;
+	} packfileDecoders[] = {
+		{ hk_2010_2_0_r1_1_0_1_4Classes, hk_2010_2_0_r1_1_0_1_4Decoders<HKXPackfileDecoder>::functions },
+	};
+
+	const HKXPackfileDecoder::Function *HKXPackfileDecoder::findDecoders(const HavokPackfileLayout *layout) {
+		for (size_t index = 0; index < sizeof(packfileDecoders) / sizeof(packfileDecoders[0]); index++) {
+			if (packfileDecoders[index].classes == layout->classes) {
+				return packfileDecoders[index].functions;
+			}
+		}
+
+		return nullptr;
+	}
+
+	void HKXPackfileDecoder::decodeGeneric(Field &value, const unsigned char *data, HavokType type, HavokType subtype, const HavokClass *typeClass) {
+		HavokClassMember member = { nullptr, typeClass, type, subtype, 0, 0, 0 };
+
+		HKXPackfileLoader::withStream(m_layoutRules, data, static_cast<size_t>(m_loader.m_mapping.data() + m_loader.m_mapping.size() - data), [&](auto &stream) {
+			stream.mark();
+
+			m_loader.deserializeField(stream, member, type, value);
+		});
+	}
+}
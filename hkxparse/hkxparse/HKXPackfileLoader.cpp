@@ -1,18 +1,179 @@
 #include <hkxparse/HKXPackfileLoader.h>
+#include <hkxparse/HKXPackfileDecoder.h>
 #include <hkxparse/PackfileTypes.h>
 #include <hkxparse/HKXMapping.h>
+#include <hkxparse/HKXDocument.h>
+#include <hkxparse/HKXTypeRegistry.h>
+#include <hkxparse/HKXTrace.h>
+#include <hkxparse/HKXExecutor.h>
 #include <hkxparse/Deserializer.h>
 #include <hkxparse/HavokPackfileLayouts.h>
 #include <hkxparse/HavokReflectionTypes.h>
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
 #include <stdexcept>
 #include <sstream>
+#include <thread>
+#include <string.h>
 
 #include <half.h>
 
 namespace hkxparse {
+	/*
+	 * The numeric and vector element layouts of packfile arrays match the
+	 * HKX types exactly, so arrays of them are read in bulk.
+	 */
+	template<typename Stream> static void readValues(Stream &stream, unsigned char *values, size_t count) { stream.readBytes(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, int16_t *values, size_t count) { stream.readI16s(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, uint16_t *values, size_t count) { stream.readU16s(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, int32_t *values, size_t count) { stream.readI32s(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, uint32_t *values, size_t count) { stream.readU32s(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, float *values, size_t count) { stream.readFloats(values, count); }
+	template<typename Stream> static void readValues(Stream &stream, HKXVector4 *values, size_t count) { readVector4s(stream, values, count); }
+	template<typename Stream> static void readValues(Stream &stream, HKXQuaternion *values, size_t count) { readQuaternions(stream, values, count); }
+	template<typename Stream> static void readValues(Stream &stream, HKXMatrix3 *values, size_t count) { readMatrix3s(stream, values, count); }
+	template<typename Stream> static void readValues(Stream &stream, HKXQsTransform *values, size_t count) { readQsTransforms(stream, values, count); }
+	template<typename Stream> static void readValues(Stream &stream, HKXMatrix4 *values, size_t count) { readMatrix4s(stream, values, count); }
+
+	template<typename Stream, typename T>
+	static void readTypedArray(Stream &stream, size_t count, HKXTypedArray<T> &ary) {
+		auto &storage = ary.storage();
+		storage.resize(count);
+		readValues(stream, storage.data(), count);
+	}
+
+	template<typename SourceType, typename Stream, typename T>
+	static void readWidenedArray(Stream &stream, size_t count, HKXTypedArray<T> &ary) {
+		std::vector<SourceType> values(count);
+		readValues(stream, values.data(), count);
+
+		auto &storage = ary.storage();
+		storage.assign(values.begin(), values.end());
+	}
+
+	// A pointer met while decoding concurrently that has to be linked after the workers are done.
+	struct PendingLink {
+		HKXVariant *value;
+		uint64_t pointer;
+		const HavokClass *classReflection;
+	};
+
+	// Set on the decodeObjects workers only.
+	static thread_local std::vector<PendingLink> *pendingLinks = nullptr;
+
+	// Fixup tables are applied in chunks of this many entries, which may run concurrently.
+	static const size_t FixupChunkSize = 16384;
+
+	// Resolves a thread count option, where 0 means as many as can run at once.
+	static unsigned int threadCount(unsigned int requested, HKXExecutor *executor) {
+		if (requested != 0)
+			return requested;
+
+		if (executor)
+			return std::max(1U, executor->concurrency());
+
+		return std::max(1U, std::thread::hardware_concurrency());
+	}
+
+	/*
+	 * Runs task(0) to task(count - 1) on up to threads threads, including
+	 * the calling one. The others are new threads, or jobs on the executor,
+	 * which are not waited for if they have not started by the time the
+	 * calling thread runs out of tasks.
+	 */
+	template<typename Task>
+	static void runConcurrently(HKXExecutor *executor, size_t count, unsigned int threads, Task &&task) {
+		std::atomic<size_t> next(0);
+		std::exception_ptr error;
+		std::mutex errorMutex;
+
+		auto worker = [&]() {
+			size_t index;
+
+			while ((index = next.fetch_add(1)) < count) {
+				try {
+					task(index);
+				}
+				catch (...) {
+					std::unique_lock<std::mutex> locker(errorMutex);
+					if (!error)
+						error = std::current_exception();
+
+					next.store(count);
+				}
+			}
+		};
+
+		auto helpers = std::min<size_t>(threads, count);
+
+		if (executor && helpers > 1) {
+			// Shared with the jobs, which may outlive this call; worker is cleared once they may no longer start it.
+			struct Jobs {
+				std::mutex mutex;
+				std::condition_variable finished;
+				std::function<void()> worker;
+				size_t running = 0;
+			};
+
+			auto jobs = std::make_shared<Jobs>();
+			jobs->worker = worker;
+
+			for (size_t job = 1; job < helpers; job++) {
+				executor->execute([jobs]() {
+					std::function<void()> worker;
+
+					{
+						std::unique_lock<std::mutex> locker(jobs->mutex);
+						if (!jobs->worker)
+							return;
+
+						worker = jobs->worker;
+						jobs->running++;
+					}
+
+					worker();
+
+					{
+						std::unique_lock<std::mutex> locker(jobs->mutex);
+						jobs->running--;
+					}
+
+					jobs->finished.notify_all();
+				});
+			}
+
+			worker();
+
+			std::unique_lock<std::mutex> locker(jobs->mutex);
+			jobs->worker = nullptr;
+			jobs->finished.wait(locker, [&]() { return jobs->running == 0; });
+		}
+		else {
+			std::vector<std::thread> workers;
+			for (size_t thread = 1; thread < helpers; thread++) {
+				workers.emplace_back(worker);
+			}
+
+			worker();
+
+			for (auto &thread : workers) {
+				thread.join();
+			}
+		}
+
+		if (error)
+			std::rethrow_exception(error);
+	}
+
+	HKXPackfileLoader::HKXPackfileLoader(HKXMapping &mapping, HKXDocument &document, const HKXLoadOptions &options) : m_mapping(mapping), m_document(document), m_options(options), m_filter(m_options), m_patchInPlace(mapping.writable()), m_decodingPending(false) {
+		if (m_mapping.size() < sizeof(PackfileHeader)) {
+			throw std::runtime_error("packfile header is out of bounds");
+		}
 
-	HKXPackfileLoader::HKXPackfileLoader(HKXMapping &mapping) : m_mapping(mapping) {
 		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
 
 		if (!header.layoutRules.littleEndian) {
@@ -23,8 +184,8 @@ namespace hkxparse {
 			throw std::runtime_error("unsupported packfile version");
 		}
 
-		m_layout = findLayout(header.contentsVersion, reinterpret_cast<const unsigned char *>(&header.layoutRules));
-		if (!m_layout) {
+		auto layout = findLayout(header.contentsVersion, reinterpret_cast<const unsigned char *>(&header.layoutRules));
+		if (!layout) {
 			std::stringstream error;
 			error << "No packfile layout for version " << header.contentsVersion << ", layout rules " <<
 				static_cast<unsigned int>(header.layoutRules.bytesInPointer) << "-" <<
@@ -34,295 +195,686 @@ namespace hkxparse {
 			throw std::runtime_error(error.str());
 		}
 
+		m_classes = &HKXPackfileClassCache::forLayout(layout);
+
+		if (header.numSections < 0 ||
+			static_cast<uint64_t>(header.numSections) > (m_mapping.size() - sizeof(PackfileHeader)) / sizeof(PackfileSectionHeader)) {
+
+			throw std::runtime_error("section table is out of bounds");
+		}
+
+		if (header.contentsSectionIndex < 0 || header.contentsSectionIndex >= header.numSections ||
+			header.contentsClassNameSectionIndex < 0 || header.contentsClassNameSectionIndex >= header.numSections) {
+
+			throw std::runtime_error("contents section index is out of range");
+		}
+
 		auto sectionHeaders = reinterpret_cast<const PackfileSectionHeader *>(&header + 1);
 
+		if (!m_patchInPlace) {
+			m_fixupIndex.resize(header.numSections);
+		}
+
+		std::vector<FixupTask> tasks;
+
 		for (int32_t sectionIndex = 0; sectionIndex < header.numSections; sectionIndex++) {
 			const auto &section = sectionHeaders[sectionIndex];
 
+			if (section.absoluteDataStart < 0 || section.localFixupsOffset < 0 ||
+				section.globalFixupsOffset < section.localFixupsOffset ||
+				section.virtualFixupsOffset < section.globalFixupsOffset ||
+				section.exportsOffset < section.virtualFixupsOffset ||
+				section.importsOffset < section.exportsOffset ||
+				section.endOffset < section.importsOffset ||
+				static_cast<uint64_t>(section.absoluteDataStart) + static_cast<uint64_t>(section.endOffset) > m_mapping.size()) {
+
+				throw std::runtime_error("section is out of bounds");
+			}
+
 			auto data = m_mapping.data() + section.absoluteDataStart;
 			auto dataSize = section.localFixupsOffset;
 
+			if (!m_patchInPlace) {
+				auto &index = m_fixupIndex[sectionIndex];
+				index.dataStart = section.absoluteDataStart;
+				index.dataEnd = section.absoluteDataStart + dataSize;
+			}
+
 			auto localFixups = data + section.localFixupsOffset;
-			auto localFixupsSize = section.globalFixupsOffset - section.localFixupsOffset;
+			size_t localFixupsSize = section.globalFixupsOffset - section.localFixupsOffset;
 
 			auto globalFixups = data + section.globalFixupsOffset;
-			auto globalFixupsSize = section.virtualFixupsOffset - section.globalFixupsOffset;
+			size_t globalFixupsSize = section.virtualFixupsOffset - section.globalFixupsOffset;
 
 			auto virtualFixups = data + section.virtualFixupsOffset;
-			auto virtualFixupsSize = section.exportsOffset - section.virtualFixupsOffset;
-
-			auto exports = data + section.exportsOffset;
-			auto exportsSize = section.importsOffset - section.exportsOffset;
+			size_t virtualFixupsSize = section.exportsOffset - section.virtualFixupsOffset;
 
-			auto imports = data + section.importsOffset;
-			auto importsSize = section.endOffset - section.importsOffset;
+			size_t exportsSize = section.importsOffset - section.exportsOffset;
+			size_t importsSize = section.endOffset - section.importsOffset;
 
 			if (localFixupsSize != 0) {
-				printf("%s: %zu bytes of local fixups\n", section.sectionTag, localFixupsSize);
-
-				Deserializer stream(header.layoutRules, localFixups, localFixupsSize);
+				HKX_TRACE("%s: %zu bytes of local fixups\n", section.sectionTag, localFixupsSize);
 
-				uint32_t offset;
-				uint32_t target;
-				while (!stream.atEnd()) {
-					stream >> offset;
-
-					if (offset == 0xFFFFFFFF)
-						break;
+				addFixupTasks(tasks, sectionIndex, FixupKind::Local, localFixups, localFixupsSize / (2 * sizeof(uint32_t)));
+			}
 
-					stream >> target;
+			if (globalFixupsSize != 0) {
+				HKX_TRACE("%s: %zu bytes of global fixups\n", section.sectionTag, globalFixupsSize);
 
-					fixup(data, dataSize, header.layoutRules, offset, section.absoluteDataStart + target);
-				}
+				addFixupTasks(tasks, sectionIndex, FixupKind::Global, globalFixups, globalFixupsSize / (3 * sizeof(uint32_t)));
 			}
 
-			if (globalFixupsSize != 0) {
-				printf("%s: %zu bytes of global fixups\n", section.sectionTag, globalFixupsSize);
+			if (virtualFixupsSize != 0) {
+				HKX_TRACE("%s: %zu bytes of virtual fixups\n", section.sectionTag, virtualFixupsSize);
 
-				Deserializer stream(header.layoutRules, globalFixups, globalFixupsSize);
+				/*
+				 * The classes are resolved up front, as classAtOffset fills a
+				 * cache that the fixup tasks can then only read.
+				 */
+				auto count = virtualFixupsSize / (3 * sizeof(uint32_t));
 
-				uint32_t offset;
-				uint32_t section;
-				uint32_t target;
-				while (!stream.atEnd()) {
-					stream >> offset;
+				std::vector<uint32_t> entries(count * 3);
+				Deserializer stream(header.layoutRules, virtualFixups, entries.size() * sizeof(uint32_t));
+				stream.readU32s(entries.data(), entries.size());
 
-					if (offset == 0xFFFFFFFF)
-						break;
+				for (size_t index = 0; index < count; index++) {
+					auto entry = &entries[index * 3];
 
-					stream >> section >> target;
+					if (entry[0] == 0xFFFFFFFF)
+						continue;
 
-					if (section >= static_cast<uint32_t>(header.numSections)) {
-						throw std::runtime_error("section index is out of range in global fixup");
+					if (entry[1] >= static_cast<uint32_t>(header.numSections)) {
+						throw std::runtime_error("section index is out of range in fixup");
 					}
 
-					fixup(data, dataSize, header.layoutRules, offset, sectionHeaders[section].absoluteDataStart + target);
+					VirtualObject object;
+					object.offset = static_cast<uint64_t>(section.absoluteDataStart) + entry[0];
+					object.className = static_cast<uint64_t>(sectionHeaders[entry[1]].absoluteDataStart) + entry[2];
+					classAtOffset(object.className);
+
+					m_virtualObjects.push_back(object);
 				}
-			}
 
-			if (virtualFixupsSize != 0) {
-				printf("%s: %zu bytes of virtual fixups\n", section.sectionTag, virtualFixupsSize);
+				addFixupTasks(tasks, sectionIndex, FixupKind::Virtual, virtualFixups, count);
+			}
 
-				Deserializer stream(header.layoutRules, virtualFixups, virtualFixupsSize);
+			if (exportsSize != 0) {
+				HKX_TRACE("%s: %zu bytes of exports\n", section.sectionTag, exportsSize);
+			}
 
-				uint32_t offset;
-				uint32_t section;
-				uint32_t target;
+			if (importsSize != 0) {
+				HKX_TRACE("%s: %zu bytes of imports\n", section.sectionTag, importsSize);
+			}
+		}
 
-				while (!stream.atEnd()) {
-					stream >> offset;
+		if (header.contentsSectionOffset < 0 || header.contentsSectionOffset >= sectionHeaders[header.contentsSectionIndex].localFixupsOffset ||
+			header.contentsClassNameSectionOffset < 0 || header.contentsClassNameSectionOffset >= sectionHeaders[header.contentsClassNameSectionIndex].localFixupsOffset) {
 
-					if (offset == 0xFFFFFFFF)
-						break;
+			throw std::runtime_error("contents are out of bounds");
+		}
 
-					stream >> section >> target;
+		auto threads = threadCount(m_options.fixupThreads, m_options.executor);
 
-					if (section >= static_cast<uint32_t>(header.numSections)) {
-						throw std::runtime_error("section index is out of range in global fixup");
-					}
+		runConcurrently(m_options.executor, tasks.size(), threads, [&](size_t index) {
+			applyFixups(tasks[index]);
+		});
 
-					auto className = reinterpret_cast<char *>(m_mapping.data() + sectionHeaders[section].absoluteDataStart + target);
+		if (!m_patchInPlace) {
+			for (auto &task : tasks) {
+				auto &fixups = m_fixupIndex[task.sectionIndex].fixups;
+				fixups.insert(fixups.end(), task.collected.begin(), task.collected.end());
+			}
 
-					auto begin = m_layout->classes;
-					auto end = m_layout->classes + m_layout->classCount;
-					auto classIt = std::lower_bound(begin, end, className, [](const HavokClass *hClass, const char *hClassName) {
-						return strcmp(hClass->name, hClassName) < 0;
-					});
+			runConcurrently(m_options.executor, m_fixupIndex.size(), threads, [&](size_t index) {
+				auto &fixups = m_fixupIndex[index].fixups;
+				std::sort(fixups.begin(), fixups.end(), [](const Fixup &a, const Fixup &b) {
+					return a.offset < b.offset;
+				});
+				fixups.shrink_to_fit();
+			});
+		}
+	}	
 
-					if (classIt == end || strcmp((*classIt)->name, className) != 0) {
-						std::stringstream error;
-						error << "No definition for class " << className;
-						throw std::runtime_error(error.str());
-					}
+	HKXPackfileLoader::~HKXPackfileLoader() {
 
-					if (classMayHaveVtable(*classIt)) {
-						fixup(data, dataSize, header.layoutRules, offset, sectionHeaders[section].absoluteDataStart + target);\
-					}
-				}
+	}
+	
+	void HKXPackfileLoader::decodeString(uint64_t pointer, HKXVariant &value) {
+		if (m_options.zeroCopy) {
+			if (pointer == 0) {
+				value.emplace<HKXStringView>();
+			}
+			else {
+				auto string = reinterpret_cast<const char *>(m_mapping.data()) + pointer;
+				value.emplace<HKXStringView>(string, strnlen(string, m_mapping.size() - static_cast<size_t>(pointer)));
 			}
+		}
+		else if (pointer == 0) {
+			value.emplace<HKXString>(m_document.allocator());
+		}
+		else {
+			value.emplace<HKXString>(reinterpret_cast<char *>(m_mapping.data()) + pointer, m_document.allocator());
+		}
+	}
 
-			if (exportsSize != 0) {
-				printf("%s: %zu bytes of exports\n", section.sectionTag, exportsSize);
+	template<typename Stream>
+	void HKXPackfileLoader::readPointer(Stream &stream, uint64_t &val) const {
+		auto slot = stream.position();
 
-				Deserializer stream(header.layoutRules, exports, exportsSize);
-			}
+		stream.readPointer(val);
 
-			if (importsSize != 0) {
-				printf("%s: %zu bytes of imports\n", section.sectionTag, importsSize);
+		if (!m_patchInPlace) {
+			val = resolvePointer(slot, val);
+		}
+	}
+
+	uint64_t HKXPackfileLoader::resolvePointer(const unsigned char *slot, uint64_t rawValue) const {
+		auto offset = static_cast<uint32_t>(slot - m_mapping.data());
+
+		for (const auto &section : m_fixupIndex) {
+			if (offset >= section.dataStart && offset < section.dataEnd) {
+				auto it = std::lower_bound(section.fixups.begin(), section.fixups.end(), offset, [](const Fixup &fixup, uint32_t offset) {
+					return fixup.offset < offset;
+				});
+
+				if (it != section.fixups.end() && it->offset == offset) {
+					return it->target;
+				}
 
-				Deserializer stream(header.layoutRules, imports, importsSize);
+				break;
 			}
 		}
-	}	
 
-	HKXPackfileLoader::~HKXPackfileLoader() {
+		return rawValue;
+	}
+
+	template<typename Stream, typename T>
+	void HKXPackfileLoader::readArray(Stream &stream, size_t count, HKXTypedArray<T> &ary) const {
+		auto data = stream.position();
 
+		if (m_options.zeroCopy && count != 0 && reinterpret_cast<uintptr_t>(data) % alignof(T) == 0) {
+			stream.skip(count * sizeof(T));
+			ary.setView(reinterpret_cast<const T *>(data), count);
+		}
+		else {
+			readTypedArray(stream, count, ary);
+		}
 	}
-	
-	bool HKXPackfileLoader::classMayHaveVtable(const HavokClass *classReflection) const {
-		auto begin = m_layout->typeInfos;
-		auto end = m_layout->typeInfos + m_layout->typeInfoCount;
-		auto classIt = std::lower_bound(begin, end, classReflection->name, [](const HavokTypeInfo *hClass, const char *hClassName) {
-			return strcmp(hClass->name, hClassName) < 0;
-		});
 
-		if (classIt == end || strcmp((*classIt)->name, classReflection->name) != 0)
-			return true;
+	HKXStructRef HKXPackfileLoader::loadRoot() {
+		beginLoad();
+		loadStep(HKXLoadBudget());
+
+		return m_root;
+	}
+
+	void HKXPackfileLoader::beginLoad() {
+		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
+		auto sectionHeaders = reinterpret_cast<const PackfileSectionHeader *>(&header + 1);
+
+		size_t classNameOffset = sectionHeaders[header.contentsClassNameSectionIndex].absoluteDataStart + header.contentsClassNameSectionOffset;
+
+		size_t dataOffset = sectionHeaders[header.contentsSectionIndex].absoluteDataStart + header.contentsSectionOffset;
 
-		printf("vtable for %s is %08llX\n", classReflection->name, (*classIt)->vtable);
+		if (m_options.decodeThreads != 1 && !m_options.lazy) {
+			decodeObjects(threadCount(m_options.decodeThreads, m_options.executor));
+		}
 
-		return (*classIt)->vtable != 0;
+		m_root = queueStructure(dataOffset, classAtOffset(classNameOffset).reflection);
 	}
 
-	HKXStructRef HKXPackfileLoader::loadRoot() {
+	bool HKXPackfileLoader::loadStep(const HKXLoadBudget &budget) {
+		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
+
+		HKXBudgetTracker tracker(budget);
+
+		return decodePending(header.layoutRules, tracker);
+	}
+
+	const unsigned char *HKXPackfileLoader::rootObject(const HavokClass *viewClass) const {
+		if (!m_patchInPlace)
+			throw std::logic_error("packfile views require a writable mapping");
+
 		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
 		auto sectionHeaders = reinterpret_cast<const PackfileSectionHeader *>(&header + 1);
 
 		auto className = reinterpret_cast<char *>(m_mapping.data()) + sectionHeaders[header.contentsClassNameSectionIndex].absoluteDataStart + header.contentsClassNameSectionOffset;
 
-		size_t dataOffset = sectionHeaders[header.contentsSectionIndex].absoluteDataStart + header.contentsSectionOffset;
+		auto rootClass = m_classes->findClass(className);
+		while (rootClass && rootClass != viewClass)
+			rootClass = rootClass->parent;
+
+		if (!rootClass)
+			throw std::runtime_error(std::string("root object of class ") + className + " is not a " + viewClass->name);
 
-		return parseStructureAtPointer(header.layoutRules, dataOffset, className);
+		return m_mapping.data() + sectionHeaders[header.contentsSectionIndex].absoluteDataStart + header.contentsSectionOffset;
 	}
 
-	template<typename ClassArgType>
-	HKXStructRef HKXPackfileLoader::parseStructureAtPointer(const LayoutRules &layoutRules, uint64_t pointer, ClassArgType classArg) {
+	HKXStructRef HKXPackfileLoader::parseStructureAtPointer(const LayoutRules &layoutRules, uint64_t pointer, const HavokClass *classReflection) {
+		auto ptr = queueStructure(pointer, classReflection);
+
+		HKXBudgetTracker unbounded((HKXLoadBudget()));
+		decodePending(layoutRules, unbounded);
+
+		return ptr;
+	}
+
+	// Allocates the structure at pointer, if it has not been yet, and queues it to be decoded.
+	HKXStructRef HKXPackfileLoader::queueStructure(uint64_t pointer, const HavokClass *classReflection) {
 		if (!pointer)
 			return HKXStructRef();
 
 		auto it = m_structures.find(pointer);
-		if (it == m_structures.end()) {
-			auto ptr = std::make_shared<HKXStruct>();
-			m_structures.emplace(pointer, ptr);
+		if (it != m_structures.end())
+			return it->second;
+
+		auto ptr = m_document.allocateStruct();
+		m_structures.emplace(pointer, ptr);
+
+		if (m_options.lazy) {
+			ptr->lazy = m_document.allocateLazyState(this, pointer, classReflection);
+			return ptr;
+		}
 
-			printf("pointer: %llu\n", pointer);
+		m_pending.push_back({ pointer, classReflection, ptr });
+		std::push_heap(m_pending.begin(), m_pending.end(), std::greater<PendingObject>());
 
-			Deserializer stream(layoutRules, m_mapping.data() + pointer, m_mapping.size() - static_cast<size_t>(pointer));
+		return ptr;
+	}
 
-			parseStructure(classArg, stream, *ptr);
+	/*
+	 * Decodes the queued structures, lowest offset first, along with the
+	 * ones that they queue in turn, until the queue is empty or the budget
+	 * is spent. Only the outermost call does anything: the calls made while
+	 * decoding leave their structures in the queue.
+	 */
+	bool HKXPackfileLoader::decodePending(const LayoutRules &layoutRules, HKXBudgetTracker &tracker) {
+		if (m_decodingPending)
+			return false;
 
-			return ptr;
+		m_decodingPending = true;
+
+		try {
+			while (!m_pending.empty() && !tracker.exhausted()) {
+				std::pop_heap(m_pending.begin(), m_pending.end(), std::greater<PendingObject>());
+				auto object = m_pending.back();
+				m_pending.pop_back();
+
+				HKX_TRACE("pointer: %llu\n", object.offset);
+
+				withStream(layoutRules, m_mapping.data() + object.offset, m_mapping.size() - static_cast<size_t>(object.offset), [&](auto &stream) {
+					parseStructure(object.classReflection, stream, *object.target, true);
+				});
+
+				tracker.consume(object.classReflection->objectSize);
+			}
+		}
+		catch (...) {
+			m_pending.clear();
+			m_decodingPending = false;
+			throw;
+		}
+
+		m_decodingPending = false;
+
+		return m_pending.empty();
+	}
+
+	void HKXPackfileLoader::linkStructure(HKXVariant &value, const LayoutRules &layoutRules, uint64_t pointer, const HavokClass *classReflection) {
+		auto pending = pendingLinks;
+
+		if (!pending || !pointer) {
+			value = parseStructureAtPointer(layoutRules, pointer, classReflection);
+			return;
+		}
+
+		// Decoding concurrently: m_structures is only read, and the structures that are not in it yet are linked afterwards.
+		auto it = m_structures.find(pointer);
+		if (it != m_structures.end()) {
+			value = it->second;
 		}
 		else {
-			return it->second;
+			value = HKXStructRef();
+			pending->push_back({ &value, pointer, classReflection });
 		}
 	}
 
-	void HKXPackfileLoader::fixup(unsigned char *data, size_t dataSize, const LayoutRules &layoutRules, size_t offset, size_t target) {
+	void HKXPackfileLoader::decodeObjects(unsigned int threads) {
+		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
+
+		/*
+		 * Every object with a vtable is allocated and entered into m_structures
+		 * up front, so that the workers only ever read the map.
+		 */
+		struct Object {
+			uint64_t offset;
+			const HavokClass *classReflection;
+			HKXStructRef target;
+		};
+
+		std::vector<Object> objects;
+		objects.reserve(m_virtualObjects.size());
+
+		for (const auto &object : m_virtualObjects) {
+			if (object.offset == 0 || m_structures.count(object.offset) != 0)
+				continue;
+
+			if (object.offset >= m_mapping.size())
+				throw std::runtime_error("virtual fixup is out of bounds");
+
+			auto classReflection = classAtOffset(object.className).reflection;
+			classInfo(classReflection);
+
+			auto ptr = m_document.allocateStruct();
+			m_structures.emplace(object.offset, ptr);
+			objects.push_back({ object.offset, classReflection, ptr });
+		}
+
+		std::vector<std::vector<PendingLink>> links(threads);
+		std::atomic<size_t> next(0);
+
+		runConcurrently(m_options.executor, threads, threads, [&](size_t worker) {
+			HKXDocument::ThreadArena arena(m_document);
+
+			pendingLinks = &links[worker];
+
+			try {
+				size_t index;
+
+				while ((index = next.fetch_add(1)) < objects.size()) {
+					const auto &object = objects[index];
+
+					withStream(header.layoutRules, m_mapping.data() + object.offset, m_mapping.size() - static_cast<size_t>(object.offset), [&](auto &stream) {
+						parseStructure(object.classReflection, stream, *object.target, true);
+					});
+				}
+			}
+			catch (...) {
+				pendingLinks = nullptr;
+				throw;
+			}
+
+			pendingLinks = nullptr;
+		});
+
+		// Pointers to objects that are not in the virtual fixup table are followed serially.
+		for (const auto &workerLinks : links) {
+			for (const auto &link : workerLinks) {
+				*link.value = parseStructureAtPointer(header.layoutRules, link.pointer, link.classReflection);
+			}
+		}
+	}
+
+	void HKXPackfileLoader::materialize(HKXStruct &target) {
+		std::unique_lock<std::mutex> locker(m_lazyMutex);
+
+		auto state = target.lazy;
+		if (state->materialized.load(std::memory_order_relaxed))
+			return;
+
+		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
+
+		withStream(header.layoutRules, m_mapping.data() + state->offset, m_mapping.size() - static_cast<size_t>(state->offset), [&](auto &stream) {
+			parseStructure(static_cast<const HavokClass *>(state->typeInfo), stream, target, true);
+		});
+
+		state->materialized.store(true, std::memory_order_release);
+	}
+
+	void HKXPackfileLoader::addFixupTasks(std::vector<FixupTask> &tasks, int32_t sectionIndex, FixupKind kind, const unsigned char *entries, size_t count) {
+		auto entrySize = (kind == FixupKind::Local ? 2 : 3) * sizeof(uint32_t);
+
+		for (size_t first = 0; first < count; first += FixupChunkSize) {
+			FixupTask task;
+			task.sectionIndex = sectionIndex;
+			task.kind = kind;
+			task.entries = entries + first * entrySize;
+			task.count = std::min(count - first, FixupChunkSize);
+			tasks.emplace_back(std::move(task));
+		}
+	}
+
+	/*
+	 * Applies a chunk of a fixup table. Offsets of 0xFFFFFFFF are the
+	 * padding at the end of the tables, and are skipped.
+	 */
+	void HKXPackfileLoader::applyFixups(FixupTask &task) const {
+		const auto &header = *reinterpret_cast<PackfileHeader *>(m_mapping.data());
+		auto sectionHeaders = reinterpret_cast<const PackfileSectionHeader *>(&header + 1);
+		const auto &section = sectionHeaders[task.sectionIndex];
+
+		auto data = m_mapping.data() + section.absoluteDataStart;
+		size_t dataSize = section.localFixupsOffset;
+
+		auto entrySize = task.kind == FixupKind::Local ? 2 : 3;
+
+		std::vector<uint32_t> entries(task.count * entrySize);
+		Deserializer stream(header.layoutRules, task.entries, entries.size() * sizeof(uint32_t));
+		stream.readU32s(entries.data(), entries.size());
+
+		if (task.kind == FixupKind::Local && m_patchInPlace) {
+			if (header.layoutRules.bytesInPointer == 4) {
+				patchLocalFixups<uint32_t>(data, dataSize, section.absoluteDataStart, entries.data(), task.count);
+			}
+			else if (header.layoutRules.bytesInPointer == 8) {
+				patchLocalFixups<uint64_t>(data, dataSize, section.absoluteDataStart, entries.data(), task.count);
+			}
+			else {
+				throw std::runtime_error("unsupported pointer size");
+			}
+
+			return;
+		}
+
+		for (size_t index = 0; index < task.count; index++) {
+			auto entry = &entries[index * entrySize];
+			auto offset = entry[0];
+
+			if (offset == 0xFFFFFFFF)
+				continue;
+
+			uint64_t target;
+
+			if (task.kind == FixupKind::Local) {
+				target = static_cast<uint64_t>(section.absoluteDataStart) + entry[1];
+			}
+			else {
+				if (entry[1] >= static_cast<uint32_t>(header.numSections)) {
+					throw std::runtime_error("section index is out of range in fixup");
+				}
+
+				target = static_cast<uint64_t>(sectionHeaders[entry[1]].absoluteDataStart) + entry[2];
+
+				if (task.kind == FixupKind::Virtual && !m_namedClasses.at(target)->mayHaveVtable)
+					continue;
+			}
+
+			fixup(task, data, dataSize, header.layoutRules, offset, target);
+		}
+	}
+
+	/*
+	 * Local fixups are the bulk of them, and need neither a section lookup
+	 * nor a class check: this is a plain scatter of the targets, which the
+	 * compiler can unroll.
+	 */
+	template<typename PointerType>
+	void HKXPackfileLoader::patchLocalFixups(unsigned char *data, size_t dataSize, uint64_t base, const uint32_t *entries, size_t count) {
+		if (dataSize < sizeof(PointerType))
+			dataSize = 0;
+		else
+			dataSize -= sizeof(PointerType);
+
+		for (size_t index = 0; index < count; index++) {
+			auto offset = entries[index * 2];
+			auto target = static_cast<PointerType>(base + entries[index * 2 + 1]);
+
+			if (offset == 0xFFFFFFFF)
+				continue;
+
+			if (offset > dataSize) {
+				throw std::runtime_error("fixup is out of bounds");
+			}
+
+			memcpy(data + offset, &target, sizeof(target));
+		}
+	}
+
+	void HKXPackfileLoader::fixup(FixupTask &task, unsigned char *data, size_t dataSize, const LayoutRules &layoutRules, size_t offset, uint64_t target) const {
+		if (offset > dataSize || dataSize - offset < layoutRules.bytesInPointer || target > m_mapping.size()) {
+			throw std::runtime_error("fixup is out of bounds");
+		}
+
+		if (!m_patchInPlace) {
+			const auto &index = m_fixupIndex[task.sectionIndex];
+			task.collected.push_back({ static_cast<uint32_t>(index.dataStart + offset), static_cast<uint32_t>(target) });
+			return;
+		}
+
 		if (layoutRules.bytesInPointer == 4) {
-			*reinterpret_cast<uint32_t *>(data + offset) = static_cast<uint32_t>(target);
+			auto value = static_cast<uint32_t>(target);
+			memcpy(data + offset, &value, sizeof(value));
 		}
 		else if (layoutRules.bytesInPointer == 8) {
-			*reinterpret_cast<uint64_t *>(data + offset) = static_cast<uint64_t>(target);
+			memcpy(data + offset, &target, sizeof(target));
 		}
 		else {
 			throw std::runtime_error("unsupported pointer size");
 		}
 	}
-	
-	void HKXPackfileLoader::parseStructure(const char *className, Deserializer &stream, HKXStruct &target) {
-		auto begin = m_layout->classes;
-		auto end = m_layout->classes + m_layout->classCount;
-		auto classIt = std::lower_bound(begin, end, className, [](const HavokClass *hClass, const char *hClassName) {
-			return strcmp(hClass->name, hClassName) < 0;
-		});
 
-		if (classIt == end || strcmp((*classIt)->name, className) != 0) {
-			std::stringstream error;
-			error << "No definition for class " << className;
-			throw std::runtime_error(error.str());
+	const HKXPackfileLoader::ClassInfo &HKXPackfileLoader::classAtOffset(uint64_t nameOffset) {
+		{
+			std::shared_lock<std::shared_mutex> lock(m_classMutex);
+
+			auto it = m_namedClasses.find(nameOffset);
+			if (it != m_namedClasses.end())
+				return *it->second;
 		}
 
-		return parseStructure(*classIt, stream, target);
-	}		
+		if (nameOffset >= m_mapping.size())
+			throw std::runtime_error("class name is out of bounds");
+
+		const auto &info = m_classes->classNamed(reinterpret_cast<const char *>(m_mapping.data() + nameOffset));
+
+		std::unique_lock<std::shared_mutex> lock(m_classMutex);
+
+		return *m_namedClasses.emplace(nameOffset, &info).first->second;
+	}
 	
-	void HKXPackfileLoader::parseStructure(const HavokClass *classReflection, Deserializer &stream, HKXStruct &target, bool nested) {
-		if (!nested) {
-			if (classMayHaveVtable(classReflection)) {
-				printf("checking for override of %s\n", classReflection->name);
-				uint64_t className;
+	template<typename Stream>
+	void HKXPackfileLoader::parseStructure(const HavokClass *classReflection, Stream &stream, HKXStruct &target, bool referenced) {
+		parseStructure(&classInfo(classReflection), stream, target, referenced);
+	}
 
-				stream.mark();
-				stream.readPointer(className);
-				stream.seekFromMark(0);
+	template<typename Stream>
+	void HKXPackfileLoader::parseStructure(const ClassInfo *info, Stream &stream, HKXStruct &target, bool referenced) {
+		auto classReflection = info->reflection;
 
-				if (className != 0) {
+		if (info->mayHaveVtable) {
+			HKX_TRACE("checking for override of %s\n", classReflection->name);
+			uint64_t className;
 
-					auto classNameStr = reinterpret_cast<char *>(m_mapping.data() + className);
+			stream.mark();
+			readPointer(stream, className);
+			stream.seekFromMark(0);
 
-					bool classFound = false;
+			if (className != 0) {
 
+				auto classNameStr = reinterpret_cast<char *>(m_mapping.data() + className);
 
-					auto begin = m_layout->classes;
-					auto end = m_layout->classes + m_layout->classCount;
-					auto classIt = std::lower_bound(begin, end, classNameStr, [](const HavokClass *hClass, const char *hClassName) {
-						return strcmp(hClass->name, hClassName) < 0;
-					});
+				bool classFound = false;
 
-					if (classIt == end || strcmp((*classIt)->name, classNameStr) != 0) {
-						std::stringstream error;
-						error << "No definition for class " << classNameStr;
-						throw std::runtime_error(error.str());
-					}
+				const auto &actualInfo = classAtOffset(className);
+				auto actualClass = actualInfo.reflection;
 
-					for (auto classInChain = *classIt; classInChain; classInChain = classInChain->parent) {
-						if (classInChain == classReflection) {
-							classFound = true;
-						}
+				for (auto classInChain = actualClass; classInChain; classInChain = classInChain->parent) {
+					if (classInChain == classReflection) {
+						classFound = true;
 					}
+				}
 
-					if (!classFound) {
-						std::stringstream error;
-						error << "VTable mismatch: vtable points to " << classNameStr << ", but it is not derived from " << classReflection->name;
-						throw std::runtime_error(error.str());
-					}
+				if (!classFound) {
+					std::stringstream error;
+					error << "VTable mismatch: vtable points to " << classNameStr << ", but it is not derived from " << classReflection->name;
+					throw std::runtime_error(error.str());
+				}
 
-					if (*classIt != classReflection) {
-						printf("renamed %s to %s\n", classReflection->name, classNameStr);
+				if (actualClass != classReflection) {
+					HKX_TRACE("renamed %s to %s\n", classReflection->name, classNameStr);
 
-						classReflection = *classIt;
-					}
+					classReflection = actualClass;
+					info = &actualInfo;
 				}
 			}
 		}
 
-		printf("deserializing %s, nested %d\n", classReflection->name, nested);
+		target.setType(info->descriptor);
+
+		if (referenced && !m_filter.objectAllowed(info->descriptor))
+			return;
+
+		auto fieldMask = m_filter.fieldMask(info->descriptor);
 
-		if (classReflection->parent) {
-			parseStructure(classReflection->parent, stream, target, true);
-			printf("back to %s\n", classReflection->name);
+		if (info->decode && !fieldMask) {
+			stream.mark();
+
+			auto object = stream.position();
+			if (static_cast<size_t>(m_mapping.data() + m_mapping.size() - object) < classReflection->objectSize) {
+				throw std::runtime_error("out of bounds read");
+			}
+
+			HKXPackfileDecoder decoder(*this, stream.layoutRules());
+			info->decode(decoder, object, target.fields.data());
+		}
+		else {
+			stream.mark();
+			parseMembers(*info, stream, target, fieldMask);
 		}
 
-		target.classNames.emplace_back(classReflection->name);
+		stream.seekFromMark(classReflection->objectSize);
+	}
+
+	template<typename Stream>
+	void HKXPackfileLoader::parseMembers(const ClassInfo &info, Stream &stream, HKXStruct &target, const std::vector<bool> *fieldMask) {
+		HKX_TRACE("deserializing %s\n", info.reflection->name);
+
+		for (size_t slot = 0; slot < info.plan.size(); slot++) {
+			if (fieldMask && !(*fieldMask)[slot])
+				continue;
+
+			const auto &entry = info.plan[slot];
+			const auto &member = *entry.member;
 
-		stream.mark();
+			HKX_TRACE("member: %s, type: %u, subtype: %u, array size: %u, flags: %u, offset: %u\n", member.name, member.type, member.subtype, member.arraySize, member.flags, member.offset);
 
-		for (size_t memberIndex = 0; memberIndex < classReflection->numDeclaredMembers; memberIndex++) {
-			auto &member = classReflection->declaredMembers[memberIndex];
+			if (entry.nested) {
+				auto &nested = target.fields[slot].emplace<HKXStruct>(m_document.allocator());
 
-			printf("member: %s, type: %u, subtype: %u, array size: %u, flags: %u, offset: %u\n", member.name, member.type, member.subtype, member.arraySize, member.flags, member.offset);
+				auto mark = stream.getMark();
 
-			if (!(member.flags & 1024)) {
-				auto &it = target.fields.emplace(member.name, std::monostate());
-				deserializeField(stream, member, it.first->second);
+				stream.seekFromMark(member.offset);
+				parseStructure(entry.nested, stream, nested, false);
+
+				stream.mark(mark);
+			}
+			else {
+				deserializeField(stream, member, target.fields[slot]);
 			}
 		}
 
-		if (nested) {
-			stream.seekFromMark(0);
-		}
-		else {
-			stream.seekFromMark(classReflection->objectSize);
-		}
+		stream.seekFromMark(0);
 	}
 
-	void HKXPackfileLoader::deserializeField(Deserializer &stream, const HavokClassMember &member, HKXVariant &value) {
+	template<typename Stream>
+	void HKXPackfileLoader::deserializeField(Stream &stream, const HavokClassMember &member, HKXVariant &value) {
 		stream.seekFromMark(member.offset);
 
 		deserializeField(stream, member, member.type, value);
 	}
 
-	void HKXPackfileLoader::deserializeField(Deserializer &stream, const HavokClassMember &member, HavokType type, HKXVariant &value) {
+	template<typename Stream>
+	void HKXPackfileLoader::deserializeField(Stream &stream, const HavokClassMember &member, HavokType type, HKXVariant &value) {
 		switch (type) {
 		case HavokType::Void:
 		case HavokType::Zero:
@@ -462,10 +1014,10 @@ namespace hkxparse {
 		case HavokType::Pointer:
 		{
 			uint64_t ptr;
-			stream.readPointer(ptr);
+			readPointer(stream, ptr);
 
 			if (member.subtype == HavokType::Struct || (member.subtype == HavokType::Pointer && member.typeClass)) {
-				value = parseStructureAtPointer(stream.layoutRules(), ptr, member.typeClass);
+				linkStructure(value, stream.layoutRules(), ptr, member.typeClass);
 			}
 			else {
 				__debugbreak();
@@ -482,28 +1034,94 @@ namespace hkxparse {
 
 			uint64_t ptr;
 			uint32_t len;
-			stream.readPointer(ptr);
+			readPointer(stream, ptr);
 			stream >> len;
 			
-			printf("array: ptr %llu, length %u\n", ptr, len);
+			HKX_TRACE("array: ptr %llu, length %u\n", ptr, len);
+
+			Stream arrayStream(stream.layoutRules(), m_mapping.data() + ptr, static_cast<size_t>(m_mapping.size() - ptr));
+
+			switch (member.subtype) {
+			case HavokType::Int8:
+			case HavokType::UInt8:
+				readArray(arrayStream, len, value.emplace<HKXByteArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Int16:
+				readWidenedArray<int16_t>(arrayStream, len, value.emplace<HKXIntArray>(m_document.allocator()));
+				break;
+
+			case HavokType::UInt16:
+				readWidenedArray<uint16_t>(arrayStream, len, value.emplace<HKXIntArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Int32:
+				readArray(arrayStream, len, value.emplace<HKXIntArray>(m_document.allocator()));
+				break;
+
+			case HavokType::UInt32:
+				readArray(arrayStream, len, value.emplace<HKXUIntArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Real:
+				readArray(arrayStream, len, value.emplace<HKXRealArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Half:
+			{
+				std::vector<uint16_t> halves(len);
+				arrayStream.readU16s(halves.data(), halves.size());
 
-			Deserializer arrayStream(stream.layoutRules(), m_mapping.data() + ptr, static_cast<size_t>(m_mapping.size() - ptr));
+				auto &storage = value.emplace<HKXRealArray>(m_document.allocator()).storage();
+				storage.resize(len);
 
-			if (member.subtype == HavokType::Int8 || member.subtype == HavokType::UInt8) {
-				std::vector<unsigned char> data(len);
-				arrayStream.readBytes(data.data(), data.size());
+				for (size_t index = 0; index < len; index++) {
+					union {
+						float f;
+						uint32_t i;
+					} u;
+
+					u.i = half_to_float(halves[index]);
+					storage[index] = u.f;
+				}
 
-				value = std::move(data);
+				break;
 			}
-			else {
-				value = HKXArray();
-				auto &ary = std::get<HKXArray>(value);
+
+			case HavokType::Vector4:
+				readArray(arrayStream, len, value.emplace<HKXVector4Array>(m_document.allocator()));
+				break;
+
+			case HavokType::Quaternion:
+				readArray(arrayStream, len, value.emplace<HKXQuaternionArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Matrix3:
+			case HavokType::Rotation:
+				readArray(arrayStream, len, value.emplace<HKXMatrix3Array>(m_document.allocator()));
+				break;
+
+			case HavokType::QsTransform:
+				readArray(arrayStream, len, value.emplace<HKXQsTransformArray>(m_document.allocator()));
+				break;
+
+			case HavokType::Matrix4:
+			case HavokType::Transform:
+				readArray(arrayStream, len, value.emplace<HKXMatrix4Array>(m_document.allocator()));
+				break;
+
+			default:
+			{
+				auto &ary = value.emplace<HKXArray>(m_document.allocator());
 
 				ary.values.resize(len);
 
 				for (size_t index = 0; index < len; index++) {
 					deserializeField(arrayStream, member, member.subtype, ary.values[index]);
 				}
+
+				break;
+			}
 			}
 
 			break;
@@ -519,11 +1137,11 @@ namespace hkxparse {
 
 		case HavokType::Struct:
 		{
-			value = HKXStruct();
+			auto &nested = value.emplace<HKXStruct>(m_document.allocator());
 
 			auto mark = stream.getMark();
 
-			parseStructure(member.typeClass, stream, std::get<HKXStruct>(value));
+			parseStructure(member.typeClass, stream, nested, false);
 
 			stream.mark(mark);
 
@@ -577,14 +1195,8 @@ namespace hkxparse {
 		{
 			uint64_t val;
 
-			stream.readPointer(val);
-
-			if (val == 0) {
-				value = std::string();
-			}
-			else {
-				value = reinterpret_cast<char *>(m_mapping.data()) + val;
-			}
+			readPointer(stream, val);
+			decodeString(val, value);
 
 			break;
 		}
@@ -594,4 +1206,8 @@ namespace hkxparse {
 			break;
 		}
 	}
-}
\ No newline at end of file
+
+	// Used by HKXPackfileDecoder::decodeGeneric
+	template void HKXPackfileLoader::deserializeField(HKXPackfileLoader::Stream32 &stream, const HavokClassMember &member, HavokType type, HKXVariant &value);
+	template void HKXPackfileLoader::deserializeField(HKXPackfileLoader::Stream64 &stream, const HavokClassMember &member, HavokType type, HKXVariant &value);
+}
@@ -1,5 +1,8 @@
 #include <hkxparse/HKXTagfileParser.h>
+#include <hkxparse/HKXTrace.h>
 #include <hkxparse/HKXMapping.h>
+#include <hkxparse/HKXDocument.h>
+#include <hkxparse/HKXTypeRegistry.h>
 #include <hkxparse/TagfileTypes.h>
 
 #include <sstream>
@@ -7,7 +10,20 @@
 #include <array>
 
 namespace hkxparse {
-	HKXTagfileParser::HKXTagfileParser(HKXMapping &mapping) : m_mapping(mapping), m_nextAllocatedObject(1) {
+	// Calls func with the index of every member present in the bitmap.
+	template<typename Func>
+	static void forEachPresentMember(const std::array<uint8_t, 16> &bitmap, size_t memberCount, Func &&func) {
+		for (size_t byteIndex = 0; byteIndex < (memberCount + 7) / 8; byteIndex++) {
+			unsigned int bits = bitmap[byteIndex];
+
+			for (size_t index = byteIndex * 8; bits && index < memberCount; index++, bits >>= 1) {
+				if (bits & 1)
+					func(index);
+			}
+		}
+	}
+
+	HKXTagfileParser::HKXTagfileParser(HKXMapping &mapping, HKXDocument &document, const HKXLoadOptions &options) : m_mapping(mapping), m_document(document), m_options(options), m_filter(m_options), m_nextAllocatedObject(1), m_finished(false) {
 		m_rules.bytesInPointer = 0;
 		
 		const auto &header = *reinterpret_cast<TagfileHeader *>(m_mapping.data());
@@ -24,7 +40,12 @@ namespace hkxparse {
 		m_rules.reusePaddingOptimization = 0;
 		m_rules.emptyBaseClassOptimization = 0;
 
-		m_stream = Deserializer(m_rules, m_mapping.data() + sizeof(TagfileHeader), m_mapping.size() - sizeof(TagfileHeader));
+		if (m_rules.littleEndian) {
+			m_littleStream = LittleStream(m_rules, m_mapping.data() + sizeof(TagfileHeader), m_mapping.size() - sizeof(TagfileHeader));
+		}
+		else {
+			m_bigStream = BigStream(m_rules, m_mapping.data() + sizeof(TagfileHeader), m_mapping.size() - sizeof(TagfileHeader));
+		}
 
 		TagfileTypeInfo voidType;
 		voidType.name = "BuiltinVoidType";
@@ -43,13 +64,38 @@ namespace hkxparse {
 	}
 
 	HKXStructRef HKXTagfileParser::parse() {
+		parseStep(HKXLoadBudget());
+
+		return m_root;
+	}
+
+	bool HKXTagfileParser::parseStep(const HKXLoadBudget &budget) {
+		if (m_finished)
+			return true;
+
+		HKXBudgetTracker tracker(budget);
+
+		if (m_rules.littleEndian) {
+			return parseObjects<LittleStream>(tracker);
+		}
+		else {
+			return parseObjects<BigStream>(tracker);
+		}
+	}
+
+	template<typename Stream>
+	bool HKXTagfileParser::parseObjects(HKXBudgetTracker &tracker) {
 		while (true) {
-			auto type = m_stream.readVarInt();
+			if (tracker.exhausted())
+				return false;
+
+			auto start = stream<Stream>().position();
+			auto type = stream<Stream>().readVarInt();
 
 			switch (type) {
 			case TagFileInfo:
 			{
-				auto version = m_stream.readVarInt();
+				auto version = stream<Stream>().readVarInt();
 
 				if (version == 3 || version == 4) {
 					m_stringPool.clear();
@@ -62,7 +108,7 @@ namespace hkxparse {
 					break;
 
 				case 4:
-					m_havokVersion = readString();
+					m_havokVersion = readString<Stream>();
 					break;
 
 				default:
@@ -78,29 +124,28 @@ namespace hkxparse {
 
 			case TagMetadata:
 			{
-				const auto &result = m_types.emplace_back(readTypeInfo());
+				const auto &result = m_types.emplace_back(readTypeInfo<Stream>());
 				m_typeLookup.emplace(result.name, m_types.size() - 1);
+				flattenMembers(static_cast<int32_t>(m_types.size() - 1));
 				break;
 			}
 
 			case TagObjectRemember:
 			{
-				auto it = m_objects.find(m_nextAllocatedObject);
-				if (it == m_objects.end()) {
-					printf("!!!!!!!!!! Creating new object %d\n", m_nextAllocatedObject);
-					auto obj = std::make_shared<HKXStruct>();
-					m_objects.emplace(m_nextAllocatedObject, obj);
-					m_nextAllocatedObject++;
-
-					parseStruct(*obj, 0);
+				auto &slot = objectSlot(m_nextAllocatedObject);
+				if (!slot) {
+					HKX_TRACE("!!!!!!!!!! Creating new object %d\n", m_nextAllocatedObject);
+					slot = m_document.allocateStruct();
 				}
 				else {
-					printf("!!!!!!!!!! Reusing existing object %d\n", m_nextAllocatedObject);
-					m_nextAllocatedObject++;
-
-					parseStruct(*it->second, 0);
+					HKX_TRACE("!!!!!!!!!! Reusing existing object %d\n", m_nextAllocatedObject);
 				}
 
+				m_nextAllocatedObject++;
+
+				auto obj = slot;
+				parseStruct<Stream>(*obj, 0, true);
+
 				break;
 			}
 
@@ -114,132 +159,215 @@ namespace hkxparse {
 				throw std::runtime_error(error.str());
 			}
 			}
+
+			tracker.consume(static_cast<size_t>(stream<Stream>().position() - start));
 		}
 	breakOuter:
 
-		for (const auto &pair : m_objects) {
-			if (pair.second->classNames.empty())
+		for (auto objectIndex : m_forwardReferences) {
+			if (!m_objects[objectIndex]->type)
 				throw std::logic_error("unresolved forward references still exist after parsing");
 		}
 
-		auto root = m_objects.find(1);
-		if (root == m_objects.end()) {
-			return {};
+		if (m_objects.size() >= 2) {
+			m_root = m_objects[1];
 		}
-		else {
-			return root->second;
+
+		m_finished = true;
+
+		return true;
+	}
+
+	HKXStructRef &HKXTagfileParser::objectSlot(int32_t objectIndex) {
+		// Every object takes at least a byte of the file, which bounds the valid ids.
+		if (objectIndex < 0 || static_cast<size_t>(objectIndex) >= m_mapping.size()) {
+			std::stringstream error;
+			error << "object index " << objectIndex << " is out of range";
+			throw std::runtime_error(error.str());
 		}
+
+		if (static_cast<size_t>(objectIndex) >= m_objects.size()) {
+			m_objects.resize(objectIndex + 1);
+		}
+
+		return m_objects[objectIndex];
 	}
 
-	size_t HKXTagfileParser::countMembers(int32_t classIndex) {
-		size_t memberCount = 0;
-		for (int32_t typeIndex = classIndex; typeIndex != 0; typeIndex = m_types[typeIndex].parentTypeIndex) {
-			memberCount += m_types[typeIndex].members.size();
+	void HKXTagfileParser::flattenMembers(int32_t classIndex) {
+		auto &typeInfo = m_types[classIndex];
+
+		if (typeInfo.parentTypeIndex != 0) {
+			if (typeInfo.parentTypeIndex < 0 || typeInfo.parentTypeIndex >= classIndex) {
+				throw std::runtime_error("parent type is not declared before its subtype");
+			}
+
+			typeInfo.allMembers = m_types[typeInfo.parentTypeIndex].allMembers;
 		}
 
-		return memberCount;
+		typeInfo.allMembers.reserve(typeInfo.allMembers.size() + typeInfo.members.size());
+
+		for (const auto &member : typeInfo.members) {
+			TagfileFlatMember flat;
+			flat.info = &member;
+			flat.classIndex = 0;
+
+			if (!member.className.empty()) {
+				auto it = m_typeLookup.find(member.className);
+				flat.classIndex = it == m_typeLookup.end() ? -1 : it->second;
+			}
+
+			typeInfo.allMembers.push_back(flat);
+		}
 	}
 
-	void HKXTagfileParser::parseStruct(HKXStruct &st, int32_t classIndex) {
+	int32_t HKXTagfileParser::memberClass(const TagfileFlatMember &member) const {
+		if (member.classIndex >= 0)
+			return member.classIndex;
+
+		// Declared after the type of the member
+		auto it = m_typeLookup.find(member.info->className);
+		if (it == m_typeLookup.end()) {
+			std::stringstream stream;
+			stream << "Class " << member.info->className << " not found";
+			throw std::logic_error(stream.str());
+		}
+
+		return it->second;
+	}
+
+	template<typename Stream>
+	void HKXTagfileParser::parseStruct(HKXStruct &st, int32_t classIndex, bool referenced) {
 		// TagObjectRemember
 
 		if (classIndex == 0) {
-			classIndex = m_stream.readVarInt();
+			classIndex = stream<Stream>().readVarInt();
 		}
 
 		const auto &typeInfo = m_types[classIndex];
-		
-		auto memberCount = countMembers(classIndex);
-
-		printf("Reading %s, total members: %zu\n", typeInfo.name.c_str(), memberCount);
 
 		MemberBitmap memberBitmap;
+		auto memberCount = readMemberBitmap<Stream>(classIndex, memberBitmap);
+
+		auto type = typeDescriptor(classIndex);
+		st.setType(type);
+
+		// The class filter only applies to objects, which are referenced through pointers.
+		auto allowed = !referenced || m_filter.objectAllowed(type);
+		auto fieldMask = m_filter.fieldMask(type);
+
+		forEachPresentMember(memberBitmap, memberCount, [&](size_t index) {
+			const auto &member = typeInfo.allMembers[index];
+
+			HKX_TRACE("Field %.*s is present\n", static_cast<int>(member.info->name.size()), member.info->name.data());
+
+			if (allowed && (!fieldMask || (*fieldMask)[index])) {
+				parseField<Stream>(st.fields[index], member);
+			}
+			else {
+				skipField<Stream>(member);
+			}
+		});
+	}
 
-		if (memberCount > memberBitmap.size() * 8)
+	template<typename Stream>
+	size_t HKXTagfileParser::readMemberBitmap(int32_t classIndex, MemberBitmap &bitmap) {
+		auto memberCount = m_types[classIndex].allMembers.size();
+
+		HKX_TRACE("Reading %.*s, total members: %zu\n", static_cast<int>(m_types[classIndex].name.size()), m_types[classIndex].name.data(), memberCount);
+
+		if (memberCount > bitmap.size() * 8)
 			throw std::logic_error("too many members");
 
-		m_stream.readBytes(memberBitmap.data(), (memberCount + 7) / 8);
+		stream<Stream>().readBytes(bitmap.data(), (memberCount + 7) / 8);
 
-		printf("Bitmap: ");
+		HKX_TRACE("Bitmap: ");
 		for (size_t index = 0; index < (memberCount + 7) / 8; index++) {
-			printf("%02X ", memberBitmap[index]);
+			HKX_TRACE("%02X ", bitmap[index]);
 		}
-		printf("\n");
+		HKX_TRACE("\n");
 
-		size_t firstIndex = 0;
-
-		parseStructMembers(st, memberBitmap, firstIndex, typeInfo);
+		return memberCount;
 	}
 
-	void HKXTagfileParser::parseStructMembers(HKXStruct &st, const MemberBitmap &bitmap, size_t &firstIndex, const TagfileTypeInfo &typeInfo) {
-		if (typeInfo.parentTypeIndex != 0) {
-			parseStructMembers(st, bitmap, firstIndex, m_types[typeInfo.parentTypeIndex]);
+	const HKXTypeDescriptor *HKXTagfileParser::typeDescriptor(int32_t classIndex) {
+		if (m_typeDescriptors.size() < m_types.size()) {
+			m_typeDescriptors.resize(m_types.size());
 		}
 
-		printf("trying %s, first member: %zu, total members: %zu\n", typeInfo.name.c_str(), firstIndex, typeInfo.members.size());
+		if (!m_typeDescriptors[classIndex]) {
+			auto &registry = HKXTypeRegistry::instance();
 
-		st.classNames.emplace_back(typeInfo.name);
+			std::vector<HKXSymbol> classNames;
+			std::vector<HKXSymbol> fieldNames;
 
-		for (const auto &field : typeInfo.members) {
-			size_t fieldIndex = firstIndex;
+			if (m_types[classIndex].parentTypeIndex != 0) {
+				auto parent = typeDescriptor(m_types[classIndex].parentTypeIndex);
+				classNames = parent->classNames;
+				fieldNames = parent->fieldNames;
+			}
 
-			printf("index %zu: %s\n", fieldIndex, field.name.c_str());
-			if (bitmap[fieldIndex / 8] & (1 << (fieldIndex % 8))) {
-				printf("Field %s is present\n", field.name.c_str());
+			classNames.push_back(registry.intern(m_types[classIndex].name));
 
-				parseField(st, field);
+			for (const auto &member : m_types[classIndex].members) {
+				fieldNames.push_back(registry.intern(member.name));
 			}
 
-			firstIndex++;
+			m_typeDescriptors[classIndex] = registry.internType(classNames, fieldNames);
 		}
 
-		printf("finish with firstIndex %zu\n", firstIndex);
-
-		//firstIndex += typeInfo.members.size();
+		return m_typeDescriptors[classIndex];
 	}
 
-	const std::string &HKXTagfileParser::readString() {
-		auto length = m_stream.readVarInt();
+	template<typename Stream>
+	std::string_view HKXTagfileParser::readString() {
+		auto length = stream<Stream>().readVarInt();
 
 		if (length <= 0) {
+			if (static_cast<size_t>(-static_cast<int64_t>(length)) >= m_stringPool.size()) {
+				throw std::runtime_error("string pool index is out of range");
+			}
+
 			return m_stringPool[-length];
 		}
 		else {
-			std::string newString;
-			newString.resize(length);
-			m_stream.readBytes(reinterpret_cast<unsigned char *>(newString.data()), newString.size());
-			
-			return m_stringPool.emplace_back(std::move(newString));
+			auto data = reinterpret_cast<const char *>(stream<Stream>().position());
+			stream<Stream>().skip(length);
+
+			return m_stringPool.emplace_back(data, length);
 		}
 	}
 
+	template<typename Stream>
 	TagfileTypeInfo HKXTagfileParser::readTypeInfo() {
 		TagfileTypeInfo info;
 
-		info.name = readString();
-		info.unk3 = m_stream.readVarInt();
-		info.parentTypeIndex = m_stream.readVarInt();
+		info.name = readString<Stream>();
+		info.unk3 = stream<Stream>().readVarInt();
+		info.parentTypeIndex = stream<Stream>().readVarInt();
 		
-		auto memberCount = m_stream.readVarInt();
+		auto memberCount = stream<Stream>().readVarInt();
 		info.members.resize(memberCount);
 
 		for (auto &member : info.members) {
-			member.name = readString();
-			member.type = m_stream.readVarInt();
+			member.name = readString<Stream>();
+			member.type = stream<Stream>().readVarInt();
 
 			if (member.type & TagTupleFlag) {
-				member.tupleSize = m_stream.readVarInt();
+				member.tupleSize = stream<Stream>().readVarInt();
 			}
 
 			if ((member.type & TagBasicTypeMask) == TagTypeObject || (member.type & TagBasicTypeMask) == TagTypeStruct) {
-				member.className = readString();
+				member.className = readString<Stream>();
 			}
 		}
 
 		return info;
 	}
 
-	void HKXTagfileParser::parseField(HKXStruct &st, const TagfileMemberInfo &member) {
+	template<typename Stream>
+	void HKXTagfileParser::parseField(HKXVariant &value, const TagfileFlatMember &flat) {
+		const auto &member = *flat.info;
+
 		if (member.type & ~(TagArrayFlag | TagTupleFlag | TagBasicTypeMask)) {
 			std::stringstream error;
 			error << "Unsupported flags in field type: " << member.type;
@@ -249,61 +377,145 @@ namespace hkxparse {
 		if (member.type == (TagTupleFlag | TagTypeByte)) {
 			// Special case: byte tuple
 
-			std::vector<unsigned char> bytes(member.tupleSize);
-			m_stream.readBytes(bytes.data(), bytes.size());
-			st.fields.emplace(member.name, std::move(bytes));
+			auto &bytes = value.emplace<HKXByteArray>(m_document.allocator()).storage();
+			bytes.resize(member.tupleSize);
+			stream<Stream>().readBytes(bytes.data(), bytes.size());
 		}
 		else if (member.type == (TagArrayFlag | TagTypeByte)) {
 			// Special case: byte array
 
-			std::vector<unsigned char> bytes(m_stream.readVarInt());
-			m_stream.readBytes(bytes.data(), bytes.size());
-			st.fields.emplace(member.name, std::move(bytes));
+			auto &bytes = value.emplace<HKXByteArray>(m_document.allocator()).storage();
+			bytes.resize(stream<Stream>().readVarInt());
+			stream<Stream>().readBytes(bytes.data(), bytes.size());
 		} else if (member.type & (TagTupleFlag | TagArrayFlag)) {
 			if ((member.type & (TagArrayFlag | TagTupleFlag)) == (TagArrayFlag | TagTupleFlag)) {
 				throw std::logic_error("member is both an array and a tuple");
 			}
 
-			auto result = st.fields.emplace(member.name, HKXArray());
-			auto &ary = std::get<HKXArray>(result.first->second);
+			size_t count;
 
 			if (member.type & TagTupleFlag) {
-				ary.values.resize(member.tupleSize);
+				count = member.tupleSize;
 			}
 			else {
-				ary.values.resize(m_stream.readVarInt());
+				count = stream<Stream>().readVarInt();
 			}
 			
-			parseArray(member, ary);
-
+			parseArray<Stream>(flat, count, value);
 		}
 		else {
-			auto result = st.fields.emplace(member.name, std::monostate());			
-			parseFieldValue(member.type & TagBasicTypeMask, member.className, result.first->second, -1);
+			parseFieldValue<Stream>(member.type & TagBasicTypeMask, flat, value, -1);
 		}
 	}
 
-	void HKXTagfileParser::parseArray(const TagfileMemberInfo &member, HKXArray &ary) {
-		auto prefix = parseArrayPrefix(member.type);
+	template<typename Stream>
+	void HKXTagfileParser::parseArray(const TagfileFlatMember &flat, size_t count, HKXVariant &value) {
+		const auto &member = *flat.info;
 
-		if ((member.type & TagBasicTypeMask) == TagTypeStruct) {
-			parseStructArray(member, ary);
+		switch (member.type & TagBasicTypeMask) {
+		case TagTypeByte:
+		{
+			auto &storage = value.emplace<HKXByteArray>(m_document.allocator()).storage();
+			storage.resize(count);
+
+			stream<Stream>().readBytes(storage.data(), storage.size());
+
+			break;
 		}
-		else {
-			for (auto &value : ary.values) {
-				parseFieldValue(member.type & TagBasicTypeMask, member.className, value, prefix);
+
+		case TagTypeInt:
+		{
+			parseArrayPrefix<Stream>(member.type);
+
+			auto &storage = value.emplace<HKXIntArray>(m_document.allocator()).storage();
+			storage.resize(count);
+
+			stream<Stream>().readVarInts(storage.data(), storage.size());
+
+			break;
+		}
+
+		case TagTypeReal:
+		{
+			auto &storage = value.emplace<HKXRealArray>(m_document.allocator()).storage();
+			storage.resize(count);
+
+			stream<Stream>().readFloats(storage.data(), storage.size());
+
+			break;
+		}
+
+		case TagTypeVec4:
+		{
+			auto components = parseArrayPrefix<Stream>(member.type);
+			if (components < 1 || components > 4) {
+				throw std::logic_error("unsupported vec4 length");
+			}
+
+			auto &storage = value.emplace<HKXVector4Array>(m_document.allocator()).storage();
+			storage.resize(count, HKXVector4{ 0.0f, 0.0f, 0.0f, 0.0f });
+
+			if (components == 4) {
+				readVector4s(stream<Stream>(), storage.data(), storage.size());
+			}
+			else {
+				for (auto &element : storage) {
+					stream<Stream>().readFloats(&element.x, components);
+				}
+			}
+
+			break;
+		}
+
+		case TagTypeVec12:
+		{
+			auto &storage = value.emplace<HKXMatrix3Array>(m_document.allocator()).storage();
+			storage.resize(count);
+
+			readMatrix3s(stream<Stream>(), storage.data(), storage.size());
+
+			break;
+		}
+
+		case TagTypeVec16:
+		{
+			auto &storage = value.emplace<HKXMatrix4Array>(m_document.allocator()).storage();
+			storage.resize(count);
+
+			readMatrix4s(stream<Stream>(), storage.data(), storage.size());
+
+			break;
+		}
+
+		case TagTypeStruct:
+			parseStructArray<Stream>(flat, count, value.emplace<HKXStructArray>(m_document.allocator()));
+			break;
+
+		default:
+		{
+			auto prefix = parseArrayPrefix<Stream>(member.type);
+
+			auto &ary = value.emplace<HKXArray>(m_document.allocator());
+			ary.values.resize(count);
+
+			for (auto &element : ary.values) {
+				parseFieldValue<Stream>(member.type & TagBasicTypeMask, flat, element, prefix);
 			}
+
+			break;
+		}
 		}
 	}
 
+	template<typename Stream>
 	int32_t HKXTagfileParser::parseArrayPrefix(unsigned int type) {
 		if ((type & TagBasicTypeMask) == TagTypeInt) {
-			printf("int prefix\n");
-			auto arrayItemWidth = m_stream.readVarInt();
+			HKX_TRACE("int prefix\n");
+			auto arrayItemWidth = stream<Stream>().readVarInt();
 			return arrayItemWidth;
 		} else if ((type & TagBasicTypeMask) == TagTypeVec4) {
-			printf("vec4 prefix\n");
-			auto numberOfMembers = m_stream.readVarInt();
+			HKX_TRACE("vec4 prefix\n");
+			auto numberOfMembers = stream<Stream>().readVarInt();
 			return numberOfMembers;
 		}
 		else {
@@ -311,22 +523,23 @@ namespace hkxparse {
 		}
 	}
 
-	void HKXTagfileParser::parseFieldValue(unsigned int type, const std::string &className, HKXVariant &value, int32_t arrayPrefix) {
-		printf("type: %u, className: %s, array prefix: %d\n", type, className.c_str(), arrayPrefix);
+	template<typename Stream>
+	void HKXTagfileParser::parseFieldValue(unsigned int type, const TagfileFlatMember &member, HKXVariant &value, int32_t arrayPrefix) {
+		HKX_TRACE("type: %u, className: %.*s, array prefix: %d\n", type, static_cast<int>(member.info->className.size()), member.info->className.data(), arrayPrefix);
 
 		switch (type) {
 		case TagTypeByte:
-			value = static_cast<uint64_t>(m_stream.readByte());
+			value = static_cast<uint64_t>(stream<Stream>().readByte());
 			break;
 
 		case TagTypeInt:
-			value = static_cast<uint64_t>(static_cast<int64_t>(m_stream.readVarInt()));
+			value = static_cast<uint64_t>(static_cast<int64_t>(stream<Stream>().readVarInt()));
 			break;
 
 		case TagTypeReal:
 		{
 			float val;
-			m_stream >> val;
+			stream<Stream>() >> val;
 			value = val;
 			break;
 		}
@@ -349,7 +562,7 @@ namespace hkxparse {
 
 			auto *ptr = &base.x;
 			for (int32_t index = 0; index < arrayPrefix; index++) {
-				m_stream >> *ptr;
+				stream<Stream>() >> *ptr;
 
 				ptr++;
 			}
@@ -359,62 +572,56 @@ namespace hkxparse {
 
 		case TagTypeVec12:
 			value = HKXMatrix3();
-			m_stream >> std::get<HKXMatrix3>(value);
+			stream<Stream>() >> std::get<HKXMatrix3>(value);
 			break;
 
 		case TagTypeVec16:
 			value = HKXMatrix4();
-			m_stream >> std::get<HKXMatrix4>(value);
+			stream<Stream>() >> std::get<HKXMatrix4>(value);
 			break;
 
 		case TagTypeObject:
 		{
-			auto objectIndex = m_stream.readVarInt();
+			auto objectIndex = stream<Stream>().readVarInt();
 			if (objectIndex == 0) {
-				printf("nullref\n");
+				HKX_TRACE("nullref\n");
 
 				value = HKXStructRef();
 			}
 			else {
-				auto it = m_objects.find(objectIndex);
-				if (it != m_objects.end()) {
-					printf("backref to %d\n", objectIndex);
-					value = it->second;
+				auto &slot = objectSlot(objectIndex);
+				if (slot) {
+					HKX_TRACE("backref to %d\n", objectIndex);
 				}
 				else {
-					printf("fwdref to %d\n", objectIndex);
-					auto obj = std::make_shared<HKXStruct>();
-					m_objects.emplace(objectIndex, obj);
-
-					value = obj;
+					HKX_TRACE("fwdref to %d\n", objectIndex);
+					slot = m_document.allocateStruct();
+					m_forwardReferences.push_back(objectIndex);
 				}
+
+				value = slot;
 			}
 
 			break;
 		}
 
 		case TagTypeStruct:
+			parseStruct<Stream>(value.emplace<HKXStruct>(m_document.allocator()), memberClass(member), false);
+			break;
+
+		case TagTypeCString:
 		{
-			int32_t classIndex = 0;
-			if (!className.empty()) {
-				auto it = m_typeLookup.find(className);
-				if (it == m_typeLookup.end()) {
-					std::stringstream stream;
-					stream << "Class " << className << " not found";
-					throw std::logic_error(stream.str());
-				}
+			auto string = readString<Stream>();
 
-				classIndex = it->second;
+			if (m_options.zeroCopy) {
+				value.emplace<HKXStringView>(string);
+			}
+			else {
+				value.emplace<HKXString>(string.data(), string.size(), m_document.allocator());
 			}
-			value = HKXStruct();
-			parseStruct(std::get<HKXStruct>(value), classIndex);
 			break;
 		}
 
-		case TagTypeCString:
-			value = readString();
-			break;
-
 		default:
 		{
 			std::stringstream error;
@@ -424,89 +631,178 @@ namespace hkxparse {
 		}
 	}
 
-	const TagfileMemberInfo *HKXTagfileParser::structMemberByIndex(const TagfileTypeInfo &typeInfo, size_t index, size_t *firstIndex) {
-		size_t firstIndexStorage = 0;
-		if (!firstIndex) {
-			firstIndex = &firstIndexStorage;
-		}
+	template<typename Stream>
+	int32_t HKXTagfileParser::readStructArrayClass(const TagfileFlatMember &member) {
+		int32_t classIndex = 0;
 
-		if (typeInfo.parentTypeIndex != 0) {
-			auto result = structMemberByIndex(m_types[typeInfo.parentTypeIndex], index, firstIndex);
-			if (result)
-				return result;
+		if (member.info->type == (TagArrayFlag | TagTypeStruct) && member.info->className.empty()) {
+			classIndex = stream<Stream>().readVarInt();
 		}
-
-		if (index - *firstIndex < typeInfo.members.size()) {
-			return &typeInfo.members[index - *firstIndex];
+		else if (!member.info->className.empty()) {
+			classIndex = memberClass(member);
 		}
-		else {
-			*firstIndex += typeInfo.members.size();
 
-			return nullptr;
+		if (classIndex == 0) {
+			throw std::logic_error("class index unknown in struct array");
 		}
+
+		return classIndex;
 	}
 
-	void HKXTagfileParser::parseStructArray(const TagfileMemberInfo &member, HKXArray &ary) {
-		int32_t classIndex = 0;
+	template<typename Stream>
+	void HKXTagfileParser::parseStructArray(const TagfileFlatMember &member, size_t count, HKXStructArray &ary) {
+		auto classIndex = readStructArrayClass<Stream>(member);
 
-		if (member.type == (TagArrayFlag | TagTypeStruct) && member.className.empty()) {
-			classIndex = m_stream.readVarInt();
-		}
-		else if (!member.className.empty()) {
-			auto it = m_typeLookup.find(member.className);
-			if (it == m_typeLookup.end()) {
-				throw std::logic_error("unable to find class");
+		const auto &typeInfo = m_types[classIndex];
+
+		MemberBitmap memberBitmap;
+		auto memberCount = readMemberBitmap<Stream>(classIndex, memberBitmap);
+
+		auto type = typeDescriptor(classIndex);
+		auto fieldMask = m_filter.fieldMask(type);
+
+		ary.setType(type, count);
+
+		// The columns are stored one after another, and are decoded straight into their typed arrays.
+		forEachPresentMember(memberBitmap, memberCount, [&](size_t index) {
+			const auto &memberType = typeInfo.allMembers[index];
+
+			if (fieldMask && !(*fieldMask)[index]) {
+				skipArray<Stream>(memberType, count);
+				return;
 			}
-			classIndex = it->second;
-		}
 
+			parseArray<Stream>(memberType, count, ary.columns[index]);
+		});
+	}
+
+	template<typename Stream>
+	void HKXTagfileParser::skipStruct(int32_t classIndex) {
 		if (classIndex == 0) {
-			throw std::logic_error("class index unknown in struct array");
+			classIndex = stream<Stream>().readVarInt();
 		}
 
-		const auto &typeInfo = m_types[classIndex];
+		MemberBitmap memberBitmap;
+		auto memberCount = readMemberBitmap<Stream>(classIndex, memberBitmap);
 
-		auto memberCount = countMembers(classIndex);
+		const auto &typeInfo = m_types[classIndex];
 
-		MemberBitmap memberBitmap;
+		forEachPresentMember(memberBitmap, memberCount, [&](size_t index) {
+			skipField<Stream>(typeInfo.allMembers[index]);
+		});
+	}
 
-		if (memberCount > memberBitmap.size() * 8)
-			throw std::logic_error("too many members");
+	template<typename Stream>
+	void HKXTagfileParser::skipField(const TagfileFlatMember &flat) {
+		const auto &member = *flat.info;
 
-		m_stream.readBytes(memberBitmap.data(), (memberCount + 7) / 8);
+		if (member.type & ~(TagArrayFlag | TagTupleFlag | TagBasicTypeMask)) {
+			std::stringstream error;
+			error << "Unsupported flags in field type: " << member.type;
+			throw std::runtime_error(error.str());
+		}
 
-		printf("Bitmap: ");
-		for (size_t index = 0; index < (memberCount + 7) / 8; index++) {
-			printf("%02X ", memberBitmap[index]);
+		if (member.type == (TagTupleFlag | TagTypeByte)) {
+			stream<Stream>().skip(member.tupleSize);
+		}
+		else if (member.type == (TagArrayFlag | TagTypeByte)) {
+			stream<Stream>().skip(stream<Stream>().readVarInt());
 		}
-		printf("\n");
+		else if (member.type & (TagTupleFlag | TagArrayFlag)) {
+			if ((member.type & (TagArrayFlag | TagTupleFlag)) == (TagArrayFlag | TagTupleFlag)) {
+				throw std::logic_error("member is both an array and a tuple");
+			}
 
-		for (auto &member : ary.values) {
-			member = HKXStruct();
-			auto &st = std::get<HKXStruct>(member);
+			size_t count;
 
-			for (auto typeIndex = classIndex; typeIndex != 0; typeIndex = m_types[typeIndex].parentTypeIndex) {
-				st.classNames.emplace_back(m_types[typeIndex].name);
+			if (member.type & TagTupleFlag) {
+				count = member.tupleSize;
 			}
+			else {
+				count = stream<Stream>().readVarInt();
+			}
+
+			skipArray<Stream>(flat, count);
 		}
+		else {
+			skipFieldValue<Stream>(member.type & TagBasicTypeMask, flat, -1);
+		}
+	}
 
-		for (int32_t index = 0; index < static_cast<int32_t>(memberCount); index++) {
-			if (memberBitmap[index / 8] & (1 << (index % 8))) {
-				auto memberType = structMemberByIndex(typeInfo, index);
+	template<typename Stream>
+	void HKXTagfileParser::skipArray(const TagfileFlatMember &member, size_t count) {
+		auto type = member.info->type;
+		auto prefix = parseArrayPrefix<Stream>(type);
 
-				HKXArray view;
-				view.values.resize(ary.values.size());
+		if ((type & TagBasicTypeMask) == TagTypeStruct) {
+			auto classIndex = readStructArrayClass<Stream>(member);
 
-				printf("parsing array for %s\n", memberType->name.c_str());
+			MemberBitmap memberBitmap;
+			auto memberCount = readMemberBitmap<Stream>(classIndex, memberBitmap);
 
-				parseArray(*memberType, view);
+			const auto &typeInfo = m_types[classIndex];
 
-				for (size_t index = 0, size = ary.values.size(); index < size; index++) {
-					std::get<HKXStruct>(ary.values[index]).fields.emplace(memberType->name, std::move(view.values[index]));
-				}
+			forEachPresentMember(memberBitmap, memberCount, [&](size_t index) {
+				skipArray<Stream>(typeInfo.allMembers[index], count);
+			});
+		}
+		else {
+			for (size_t index = 0; index < count; index++) {
+				skipFieldValue<Stream>(type & TagBasicTypeMask, member, prefix);
 			}
 		}
+	}
+
+	template<typename Stream>
+	void HKXTagfileParser::skipFieldValue(unsigned int type, const TagfileFlatMember &member, int32_t arrayPrefix) {
+		switch (type) {
+		case TagTypeByte:
+			stream<Stream>().readByte();
+			break;
+
+		case TagTypeInt:
+		case TagTypeObject:
+			stream<Stream>().readVarInt();
+			break;
+
+		case TagTypeReal:
+			stream<Stream>().skip(sizeof(float));
+			break;
 
-		printf("FINISHED WITH STRUCT ARRAY\n");
+		case TagTypeVec4:
+			if (arrayPrefix < 0) {
+				arrayPrefix = 4;
+			}
+			else if (arrayPrefix < 1 || arrayPrefix > 4) {
+				throw std::logic_error("unsupported vec4 length");
+			}
+
+			stream<Stream>().skip(arrayPrefix * sizeof(float));
+			break;
+
+		case TagTypeVec12:
+			stream<Stream>().skip(12 * sizeof(float));
+			break;
+
+		case TagTypeVec16:
+			stream<Stream>().skip(16 * sizeof(float));
+			break;
+
+		case TagTypeStruct:
+			skipStruct<Stream>(memberClass(member));
+			break;
+
+		case TagTypeCString:
+			// Still read, as new strings are added to the pool.
+			readString<Stream>();
+			break;
+
+		default:
+		{
+			std::stringstream error;
+			error << "Unsupported field type: " << type;
+			throw std::runtime_error(error.str());
+		}
+		}
 	}
 }
@@ -0,0 +1,125 @@
+#include <hkxparse/HKXTypeRegistry.h>
+
+#include <mutex>
+#include <string.h>
+
+namespace hkxparse {
+	bool HKXTypeDescriptor::isA(HKXSymbol className) const {
+		for (const auto &name : classNames) {
+			if (name == className)
+				return true;
+		}
+
+		return false;
+	}
+
+	size_t HKXTypeDescriptor::fieldIndex(const HKXFieldName &name) const {
+		for (size_t index = 0, count = fieldHashes.size(); index < count; index++) {
+			if (fieldHashes[index] == name.hash() && strcmp(fieldNames[index].c_str(), name.name()) == 0) {
+				return index;
+			}
+		}
+
+		return npos;
+	}
+
+	size_t HKXTypeDescriptor::fieldIndex(HKXSymbol name) const {
+		for (size_t index = 0, count = fieldNames.size(); index < count; index++) {
+			if (fieldNames[index] == name) {
+				return index;
+			}
+		}
+
+		return npos;
+	}
+
+	HKXTypeRegistry::HKXTypeRegistry() : m_strings(64 * 1024, std::pmr::new_delete_resource()) {
+
+	}
+
+	HKXTypeRegistry::~HKXTypeRegistry() {
+
+	}
+
+	HKXTypeRegistry &HKXTypeRegistry::instance() {
+		static HKXTypeRegistry registry;
+		return registry;
+	}
+
+	HKXSymbol HKXTypeRegistry::intern(const char *name) {
+		return intern(std::string_view(name));
+	}
+
+	HKXSymbol HKXTypeRegistry::intern(std::string_view name) {
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			auto it = m_symbols.find(name);
+			if (it != m_symbols.end())
+				return HKXSymbol(it->data());
+		}
+
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+		auto it = m_symbols.find(name);
+		if (it != m_symbols.end())
+			return HKXSymbol(it->data());
+
+		auto storage = static_cast<char *>(m_strings.allocate(name.size() + 1, 1));
+		memcpy(storage, name.data(), name.size());
+		storage[name.size()] = 0;
+
+		m_symbols.emplace(storage, name.size());
+
+		return HKXSymbol(storage);
+	}
+
+	const HKXTypeDescriptor *HKXTypeRegistry::internType(const std::vector<HKXSymbol> &classNames, const std::vector<HKXSymbol> &fieldNames) {
+		std::vector<const char *> key;
+		key.reserve(classNames.size() + fieldNames.size() + 1);
+
+		for (const auto &name : classNames) {
+			key.push_back(name.c_str());
+		}
+
+		key.push_back(nullptr);
+
+		for (const auto &name : fieldNames) {
+			key.push_back(name.c_str());
+		}
+
+		{
+			std::shared_lock<std::shared_mutex> lock(m_mutex);
+
+			auto it = m_types.find(key);
+			if (it != m_types.end())
+				return it->second.get();
+		}
+
+		std::unique_lock<std::shared_mutex> lock(m_mutex);
+
+		auto &type = m_types[std::move(key)];
+		if (!type) {
+			type = std::make_unique<HKXTypeDescriptor>();
+			type->classNames = classNames;
+			type->fieldNames = fieldNames;
+			type->fieldHashes.reserve(fieldNames.size());
+
+			for (const auto &name : fieldNames) {
+				type->fieldHashes.push_back(HKXFieldName::hash(name.c_str()));
+			}
+		}
+
+		return type.get();
+	}
+
+	size_t HKXTypeRegistry::TypeKeyHash::operator()(const std::vector<const char *> &key) const {
+		size_t value = 0;
+
+		for (auto name : key) {
+			value = value * 31 + std::hash<const char *>()(name);
+		}
+
+		return value;
+	}
+}
@@ -1,24 +1,92 @@
 #include <hkxparse/HKXTypes.h>
-#include <hkxparse/Deserializer.h>
+#include <hkxparse/HKXTypeRegistry.h>
+
+#include <stdexcept>
+#include <type_traits>
 
 namespace hkxparse {
-	Deserializer &operator >>(Deserializer &stream, HKXVector4 &val) {
-		return stream >> val.x >> val.y >> val.z >> val.w;
+	void HKXStruct::setType(const HKXTypeDescriptor *descriptor) {
+		type = descriptor;
+		fields.resize(descriptor->fieldCount());
+	}
+
+	const HKXVariant *HKXStruct::field(const HKXFieldName &name) const {
+		if (!type)
+			return nullptr;
+
+		auto index = type->fieldIndex(name);
+		if (index == HKXTypeDescriptor::npos)
+			return nullptr;
+
+		return &fields[index];
+	}
+
+	HKXVariant *HKXStruct::field(const HKXFieldName &name) {
+		return const_cast<HKXVariant *>(static_cast<const HKXStruct *>(this)->field(name));
+	}
+
+	void HKXStructArray::setType(const HKXTypeDescriptor *descriptor, size_t rowCount) {
+		type = descriptor;
+		count = rowCount;
+		columns.resize(descriptor->fieldCount());
 	}
 
-	Deserializer &operator >>(Deserializer &stream, HKXQuaternion &val) {
-		return stream >> val.vec;
+	const HKXVariant *HKXStructArray::column(const HKXFieldName &name) const {
+		if (!type)
+			return nullptr;
+
+		auto index = type->fieldIndex(name);
+		if (index == HKXTypeDescriptor::npos)
+			return nullptr;
+
+		return &columns[index];
 	}
 
-	Deserializer &operator >>(Deserializer &stream, HKXMatrix3 &val) {
-		return stream >> val.v[0] >> val.v[1] >> val.v[2];
+	HKXVariant HKXStructArray::field(size_t row, size_t slot, const HKXAllocator &allocator) const {
+		return std::visit([row, &allocator](const auto &column) -> HKXVariant {
+			using Column = std::decay_t<decltype(column)>;
+
+			if constexpr (std::is_same_v<Column, std::monostate>) {
+				return std::monostate();
+			}
+			else if constexpr (std::is_same_v<Column, HKXByteArray> || std::is_same_v<Column, HKXIntArray> || std::is_same_v<Column, HKXUIntArray>) {
+				return static_cast<uint64_t>(static_cast<int64_t>(column[row]));
+			}
+			else if constexpr (std::is_same_v<Column, HKXRealArray> || std::is_same_v<Column, HKXVector4Array> || std::is_same_v<Column, HKXQuaternionArray> ||
+				std::is_same_v<Column, HKXMatrix3Array> || std::is_same_v<Column, HKXQsTransformArray> || std::is_same_v<Column, HKXMatrix4Array>) {
+				return column[row];
+			}
+			else if constexpr (std::is_same_v<Column, HKXArray>) {
+				return column.values[row];
+			}
+			else if constexpr (std::is_same_v<Column, HKXStructArray>) {
+				return column.row(row).materialize(allocator);
+			}
+			else {
+				throw std::logic_error("struct array column is not an array");
+			}
+		}, columns[slot]);
 	}
 
-	Deserializer &operator >>(Deserializer &stream, HKXQsTransform &val) {
-		return stream >> val.translation >> val.rotation >> val.scale;
+	HKXVariant HKXStructArray::field(size_t row, const HKXFieldName &name, const HKXAllocator &allocator) const {
+		if (!type)
+			return std::monostate();
+
+		auto index = type->fieldIndex(name);
+		if (index == HKXTypeDescriptor::npos)
+			return std::monostate();
+
+		return field(row, index, allocator);
 	}
 
-	Deserializer &operator >>(Deserializer &stream, HKXMatrix4 &val) {
-		return stream >> val.v[0] >> val.v[1] >> val.v[2] >> val.v[3];
+	HKXStruct HKXStructArrayRow::materialize(const HKXAllocator &allocator) const {
+		HKXStruct result(allocator);
+		result.setType(m_array->type);
+
+		for (size_t slot = 0; slot < m_array->columns.size(); slot++) {
+			result.fields[slot] = field(slot, allocator);
+		}
+
+		return result;
 	}
 }
@@ -1,4 +1,5 @@
 #include <hkxparse/PrettyPrinter.h>
+#include <hkxparse/HKXTypeRegistry.h>
 #include <functional>
 #include <string>
 #include <algorithm>
@@ -27,45 +28,101 @@ namespace hkxparse {
 	}
 
 	void PrettyPrinter::doPrint(const HKXStruct &dictionary) {
+		printStructType(dictionary.type);
+
+		increaseLevel();
+
+		for (size_t index = 0, count = dictionary.fields.size(); index < count; index++) {
+			printKey(dictionary.type->fieldNames[index].c_str());
+			print(dictionary.fields[index]);
+		}
+
+		decreaseLevel();
+	}
+
+	void PrettyPrinter::doPrint(const HKXStructArrayRow &row) {
+		printStructType(row.type());
+
+		increaseLevel();
+
+		for (size_t index = 0, count = row.type()->fieldCount(); index < count; index++) {
+			printKey(row.type()->fieldNames[index].c_str());
+
+			if (row.isNested(index)) {
+				doPrint(row.nested(index));
+			}
+			else {
+				print(row.field(index));
+			}
+		}
+
+		decreaseLevel();
+	}
+
+	void PrettyPrinter::printStructType(const HKXTypeDescriptor *type) {
 		printValueNoNewLine("STRUCT:");
 
 		bool first = true;
 
-		for (const auto &type : dictionary.classNames) {
+		for (const auto &name : type->classNames) {
 			if (first) {
 				first = false;
 			}
 			else {
 				printValueNoNewLine(" -> ");
 			}
-			printValueNoNewLine(type.c_str());
+			printValueNoNewLine(name.c_str());
 		}
 
 		printValue("");
+	}
+
+	void PrettyPrinter::doPrint(const HKXArray &ary) {
+		printValue("ARRAY");
 
 		increaseLevel();
 
-		for (const auto &pair : dictionary.fields) {
-			printKey(pair.first.c_str());
-			print(pair.second);
+		for (const auto &item : ary.values) {
+			print(item);
 		}
 
 		decreaseLevel();
 	}
 
-	void PrettyPrinter::doPrint(const HKXArray &ary) {
+	void PrettyPrinter::doPrint(const HKXStructArray &ary) {
 		printValue("ARRAY");
 
 		increaseLevel();
 
-		for (const auto &item : ary.values) {
-			print(item);
+		for (size_t row = 0; row < ary.size(); row++) {
+			doPrint(ary.row(row));
+		}
+
+		decreaseLevel();
+	}
+
+	template<typename T>
+	void PrettyPrinter::doPrint(const HKXTypedArray<T> &ary) {
+		printValue("ARRAY");
+
+		increaseLevel();
+
+		for (const auto &item : ary) {
+			doPrint(item);
 		}
 
 		decreaseLevel();
 	}
 
-	void PrettyPrinter::doPrint(const std::vector<unsigned char> &byteArray) {
+	void PrettyPrinter::doPrint(int32_t val) {
+		printValue(std::to_string(val).c_str());
+	}
+
+	void PrettyPrinter::doPrint(uint32_t val) {
+		printValue(std::to_string(val).c_str());
+	}
+
+	void PrettyPrinter::doPrint(const HKXByteArray &byteArray) {
 		printValue("BYTEARRAY");
 
 		increaseLevel();
@@ -101,15 +158,21 @@ namespace hkxparse {
 		decreaseLevel();
 	}
 
-	void PrettyPrinter::doPrint(const std::string &string) {
+	void PrettyPrinter::doPrint(const HKXString &string) {
 		printValueNoNewLine("\"");
 		printValueNoNewLine(string.c_str());
 		printValue("\"");
 	}
 
+	void PrettyPrinter::doPrint(const HKXStringView &string) {
+		printValueNoNewLine("\"");
+		printValueNoNewLine(std::string(string).c_str());
+		printValue("\"");
+	}
+
 	void PrettyPrinter::doPrint(const HKXStructRef &ref) {
 		printValueNoNewLine("REF:");
-		printValue(std::to_string(reinterpret_cast<uintptr_t>(&*ref)).c_str());
+		printValue(std::to_string(reinterpret_cast<uintptr_t>(ref.get())).c_str());
 
 		if (ref) {
 			printReference(ref);
@@ -122,7 +185,7 @@ namespace hkxparse {
 		if (result.second) {
 			increaseLevel();
 
-			print(*ref);
+			doPrint(*ref);
 
 			decreaseLevel();
 		}
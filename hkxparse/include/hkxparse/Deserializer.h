@@ -4,55 +4,212 @@
 #include "LayoutRules.h"
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <utility>
 
 namespace hkxparse {
-	class Deserializer {
+	// Layout parameter of BasicDeserializer that is taken from the LayoutRules at run time
+	constexpr unsigned int RuntimeLayout = ~0U;
+
+	[[noreturn]] void throwDeserializerError(const char *message);
+
+	// Varint decoding, shared by all of the instantiations; advances ptr.
+	int32_t readVarInt(const unsigned char *&ptr, const unsigned char *end);
+	void readVarInts(const unsigned char *&ptr, const unsigned char *end, int32_t *target, size_t count);
+
+	// Unsigned integer of the given size, for byte swapping
+	template<size_t Size> struct DeserializerBits;
+	template<> struct DeserializerBits<1> { using Type = uint8_t; };
+	template<> struct DeserializerBits<2> { using Type = uint16_t; };
+	template<> struct DeserializerBits<4> { using Type = uint32_t; };
+	template<> struct DeserializerBits<8> { using Type = uint64_t; };
+
+	/*
+	 * Reads values in the byte order and with the pointer width of a layout.
+	 * Either can be fixed at compile time, which makes the reads branch free
+	 * and lets them inline into the loaders' loops, or RuntimeLayout, to
+	 * follow the LayoutRules passed at construction on every read.
+	 *
+	 * The loaders pick a fixed instantiation once per file; Deserializer is
+	 * the fully run time one.
+	 */
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	class BasicDeserializer {
 	public:
-		Deserializer();
-		Deserializer(const LayoutRules &layoutRules, const unsigned char *data, size_t dataSize);
-		~Deserializer();
-
-		Deserializer(const Deserializer &other) = delete;
-		Deserializer &operator =(const Deserializer &other) = delete;
-
-		Deserializer(Deserializer &&other);
-		Deserializer &operator =(Deserializer &&other);
-				
-		void readBytes(unsigned char *target, size_t size);
-		void readBool(bool &val);
-		void readPointer(uint64_t &val);
-
-		//Deserializer &operator >>(bool &val);
-		Deserializer &operator >>(char &val);
-		Deserializer &operator >>(int8_t &val);
-		Deserializer &operator >>(uint8_t &val);
-		Deserializer &operator >>(int16_t &val);
-		Deserializer &operator >>(uint16_t &val);
-		Deserializer &operator >>(int32_t &val);
-		Deserializer &operator >>(uint32_t &val);
-		Deserializer &operator >>(int64_t &val);
-		Deserializer &operator >>(uint64_t &val);
-		Deserializer &operator >>(float &val);
+		BasicDeserializer() : m_ptr(nullptr), m_end(nullptr), m_mark(nullptr) {}
+		BasicDeserializer(const LayoutRules &layoutRules, const unsigned char *data, size_t dataSize) : m_layoutRules(layoutRules), m_ptr(data), m_end(data + dataSize), m_mark(data) {}
+
+		BasicDeserializer(const BasicDeserializer &other) = delete;
+		BasicDeserializer &operator =(const BasicDeserializer &other) = delete;
+
+		BasicDeserializer(BasicDeserializer &&other) : m_ptr(nullptr), m_end(nullptr), m_mark(nullptr) {
+			*this = std::move(other);
+		}
+
+		BasicDeserializer &operator =(BasicDeserializer &&other) {
+			m_layoutRules = other.m_layoutRules;
+			std::swap(m_ptr, other.m_ptr);
+			std::swap(m_end, other.m_end);
+			std::swap(m_mark, other.m_mark);
+			return *this;
+		}
+
+		inline bool littleEndian() const {
+			if constexpr (LittleEndian == RuntimeLayout) {
+				return m_layoutRules.littleEndian != 0;
+			}
+			else {
+				return LittleEndian != 0;
+			}
+		}
+
+		inline unsigned int bytesInPointer() const {
+			if constexpr (BytesInPointer == RuntimeLayout) {
+				return m_layoutRules.bytesInPointer;
+			}
+			else {
+				return BytesInPointer;
+			}
+		}
+
+		inline void readBytes(unsigned char *target, size_t size) {
+			if (size > static_cast<size_t>(m_end - m_ptr)) {
+				throwDeserializerError("out of bounds read");
+			}
+
+			memcpy(target, m_ptr, size);
+			m_ptr += size;
+		}
+
+		inline void skip(size_t size) {
+			if (size > static_cast<size_t>(m_end - m_ptr)) {
+				throwDeserializerError("out of bounds read");
+			}
+
+			m_ptr += size;
+		}
+
+		// hkBool is a single byte
+		inline void readBool(bool &val) {
+			val = readByte() != 0;
+		}
+
+		inline void readPointer(uint64_t &val) {
+			if (bytesInPointer() == 4) {
+				uint32_t proxy;
+				*this >> proxy;
+				val = proxy;
+			}
+			else if (bytesInPointer() == 8) {
+				*this >> val;
+			}
+			else {
+				throwDeserializerError("unsupported pointer length");
+			}
+		}
+
+		// Bulk reads of count consecutive values, byte swapped if the data is big endian.
+		inline void readI16s(int16_t *target, size_t count) { readSwapped(target, count); }
+		inline void readU16s(uint16_t *target, size_t count) { readSwapped(target, count); }
+		inline void readI32s(int32_t *target, size_t count) { readSwapped(target, count); }
+		inline void readU32s(uint32_t *target, size_t count) { readSwapped(target, count); }
+		inline void readFloats(float *target, size_t count) { readSwapped(target, count); }
+
+		//BasicDeserializer &operator >>(bool &val);
+		inline BasicDeserializer &operator >>(char &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(int8_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(uint8_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(int16_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(uint16_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(int32_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(uint32_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(int64_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(uint64_t &val) { readScalar(val); return *this; }
+		inline BasicDeserializer &operator >>(float &val) { readScalar(val); return *this; }
 
 		inline const LayoutRules &layoutRules() const { return m_layoutRules; }
 
-		void mark();
+		inline void mark() { m_mark = m_ptr; }
 		inline void mark(const unsigned char *ptr) { m_mark = ptr; }
 		inline const unsigned char *getMark() const { return m_mark; }
 
-		void seekFromMark(size_t offset);
+		inline void seekFromMark(size_t offset) {
+			if (offset > static_cast<size_t>(m_end - m_mark)) {
+				throwDeserializerError("seek is out of range");
+			}
+
+			m_ptr = m_mark + offset;
+		}
 
 		bool atEnd() const { return m_ptr == m_end; }
+		inline const unsigned char *position() const { return m_ptr; }
+
+		inline uint8_t readByte() {
+			if (m_ptr == m_end) {
+				throwDeserializerError("out of bounds read");
+			}
 
-		uint8_t readByte();
-		int32_t readVarInt();
+			return *m_ptr++;
+		}
+
+		inline int32_t readVarInt() { return hkxparse::readVarInt(m_ptr, m_end); }
+		inline void readVarInts(int32_t *target, size_t count) { hkxparse::readVarInts(m_ptr, m_end, target, count); }
 
 	private:
+		static inline uint8_t byteSwap(uint8_t val) { return val; }
+#ifdef _MSC_VER
+		static inline uint16_t byteSwap(uint16_t val) { return _byteswap_ushort(val); }
+		static inline uint32_t byteSwap(uint32_t val) { return _byteswap_ulong(val); }
+		static inline uint64_t byteSwap(uint64_t val) { return _byteswap_uint64(val); }
+#else
+		static inline uint16_t byteSwap(uint16_t val) { return __builtin_bswap16(val); }
+		static inline uint32_t byteSwap(uint32_t val) { return __builtin_bswap32(val); }
+		static inline uint64_t byteSwap(uint64_t val) { return __builtin_bswap64(val); }
+#endif
+
+		template<typename T>
+		inline void readScalar(T &val) {
+			typename DeserializerBits<sizeof(T)>::Type bits;
+			readBytes(reinterpret_cast<unsigned char *>(&bits), sizeof(bits));
+
+			if (!littleEndian()) {
+				bits = byteSwap(bits);
+			}
+
+			memcpy(&val, &bits, sizeof(val));
+		}
+
+		/*
+		 * The swap is a separate pass over the target, as a simple loop that
+		 * the compiler can vectorize.
+		 */
+		template<typename T>
+		inline void readSwapped(T *target, size_t count) {
+			if (count > static_cast<size_t>(m_end - m_ptr) / sizeof(T)) {
+				throwDeserializerError("out of bounds read");
+			}
+
+			readBytes(reinterpret_cast<unsigned char *>(target), count * sizeof(T));
+
+			if (!littleEndian()) {
+				for (size_t index = 0; index < count; index++) {
+					typename DeserializerBits<sizeof(T)>::Type bits;
+					memcpy(&bits, &target[index], sizeof(bits));
+					bits = byteSwap(bits);
+					memcpy(&target[index], &bits, sizeof(bits));
+				}
+			}
+		}
+
 		LayoutRules m_layoutRules;
 		const unsigned char *m_ptr;
 		const unsigned char *m_end;
 		const unsigned char *m_mark;
 	};
+
+	using Deserializer = BasicDeserializer<RuntimeLayout, RuntimeLayout>;
 }
 
 #endif
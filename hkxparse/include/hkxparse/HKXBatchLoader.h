@@ -0,0 +1,95 @@
+#ifndef HKXPARSE_HKX_BATCH_LOADER_H
+#define HKXPARSE_HKX_BATCH_LOADER_H
+
+#include "HKXExecutor.h"
+#include "HKXFile.h"
+#include "HKXLoadOptions.h"
+#include "HKXMapping.h"
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace hkxparse {
+	/*
+	 * Loads many files concurrently on a pool of worker threads. Each file
+	 * is read and parsed by one job into its own HKXFile. A file that fails
+	 * to load only fails its own job: the exception is delivered through
+	 * its future or callback, and the other jobs go on.
+	 *
+	 * Every worker has a queue of its own. Jobs are spread over the queues
+	 * round-robin, or put on the worker's own queue when queued from a job,
+	 * and a worker whose queue is empty steals from the others.
+	 *
+	 * The class plans of each packfile layout (HKXPackfileClassCache) and
+	 * the HKXTypeRegistry are process-wide, so they are built once and
+	 * shared by all of the jobs; what each loader keeps for itself is tied
+	 * to its file, such as the class name offsets and the decisions of the
+	 * class filter. The options apply to every file. Unless they name
+	 * another executor, the loaders run their fixupThreads and
+	 * decodeThreads work on the pool too.
+	 *
+	 * The destructor waits for the jobs already queued.
+	 */
+	class HKXBatchLoader final : public HKXExecutor {
+	public:
+		// Invoked on a worker thread with either the file or the error; must not throw.
+		using Callback = std::function<void(size_t index, std::unique_ptr<HKXFile> &&file, std::exception_ptr error)>;
+
+		// threads = 0 uses one worker per hardware thread.
+		explicit HKXBatchLoader(const HKXLoadOptions &options = HKXLoadOptions(), unsigned int threads = 0);
+		~HKXBatchLoader() override;
+
+		HKXBatchLoader(const HKXBatchLoader &other) = delete;
+		HKXBatchLoader &operator =(const HKXBatchLoader &other) = delete;
+
+		std::future<std::unique_ptr<HKXFile>> load(const std::string &filename);
+		std::future<std::unique_ptr<HKXFile>> load(HKXMapping &&mapping);
+
+		// Queues all of the files; the callback gets the index of the file in filenames.
+		void load(const std::vector<std::string> &filenames, const Callback &callback);
+
+		// Blocks until every job queued so far is done.
+		void wait();
+
+		inline unsigned int threadCount() const { return static_cast<unsigned int>(m_workers.size()); }
+
+		unsigned int concurrency() const override;
+		void execute(std::function<void()> &&job) override;
+
+	private:
+		using Job = std::function<void()>;
+
+		struct WorkerQueue {
+			std::mutex mutex;
+			std::deque<Job> jobs;
+		};
+
+		std::unique_ptr<HKXFile> loadFile(const std::string &filename) const;
+		std::unique_ptr<HKXFile> loadFile(HKXMapping &&mapping) const;
+
+		void submit(Job &&job);
+		bool takeJob(size_t worker, Job &job);
+		void workerMain(size_t worker);
+
+		HKXLoadOptions m_options;
+		std::vector<std::unique_ptr<WorkerQueue>> m_queues;
+		std::vector<std::thread> m_workers;
+		std::mutex m_mutex; // guards the counters below
+		std::condition_variable m_jobQueued;
+		std::condition_variable m_allDone;
+		size_t m_queued; // jobs in the queues that no worker has claimed yet
+		size_t m_unfinished; // jobs queued or running
+		size_t m_nextQueue;
+		bool m_stopping;
+	};
+}
+
+#endif
@@ -0,0 +1,91 @@
+#ifndef HKXPARSE_HKX_DOCUMENT_H
+#define HKXPARSE_HKX_DOCUMENT_H
+
+#include <hkxparse/HKXTypes.h>
+#include <hkxparse/HKXMapping.h>
+
+#include <memory_resource>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace hkxparse {
+	/*
+	 * Owns every structure, field table, array and string produced while
+	 * loading one file. All of them are bump-allocated from a single arena
+	 * that is released as a whole when the document is destroyed; no
+	 * destructors are run and nothing is freed individually, so every
+	 * container placed into the document must be constructed with
+	 * allocator().
+	 *
+	 * The document also owns the mapping of the file it was loaded from,
+	 * so strings and arrays may refer directly into it, and, for lazy
+	 * loads, the loader that decodes the structures on demand.
+	 *
+	 * The arena itself is not thread-safe. Threads that fill the document
+	 * concurrently each hold a ThreadArena for as long as they do: the
+	 * allocations they make through allocator(), including those of
+	 * containers created on other threads, then come from an arena of
+	 * their own, which is also kept until the document is destroyed.
+	 */
+	class HKXDocument {
+	public:
+		explicit HKXDocument(HKXMapping &&mapping);
+		~HKXDocument();
+
+		HKXDocument(const HKXDocument &other) = delete;
+		HKXDocument &operator =(const HKXDocument &other) = delete;
+
+		class ThreadArena {
+		public:
+			explicit ThreadArena(HKXDocument &document);
+			~ThreadArena();
+
+			ThreadArena(const ThreadArena &other) = delete;
+			ThreadArena &operator =(const ThreadArena &other) = delete;
+
+		private:
+			friend class HKXDocument;
+
+			const HKXDocument *m_document;
+			std::pmr::memory_resource *m_arena;
+			ThreadArena *m_previous;
+		};
+
+		inline HKXAllocator allocator() { return HKXAllocator(&m_arena); }
+		inline HKXMapping &mapping() { return m_mapping; }
+
+		HKXStructRef allocateStruct();
+		HKXLazyState *allocateLazyState(HKXStructLoader *loader, uint64_t offset, const void *typeInfo);
+
+		// Keeps a lazy loader alive for as long as the structures it produced.
+		void retainLoader(std::unique_ptr<HKXStructLoader> &&loader);
+
+	private:
+		// First block of each arena; monotonic_buffer_resource grows the following ones geometrically.
+		static constexpr size_t ArenaBlockSize = 64 * 1024;
+
+		// Allocates from the ThreadArena of the calling thread, if it has one for the document.
+		class Arena final : public std::pmr::memory_resource {
+		public:
+			explicit Arena(HKXDocument &document);
+
+		protected:
+			void *do_allocate(size_t bytes, size_t alignment) override;
+			void do_deallocate(void *p, size_t bytes, size_t alignment) override;
+			bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override;
+
+		private:
+			HKXDocument &m_document;
+			std::pmr::monotonic_buffer_resource m_shared;
+		};
+
+		HKXMapping m_mapping;
+		Arena m_arena;
+		std::mutex m_threadArenasMutex;
+		std::vector<std::unique_ptr<std::pmr::monotonic_buffer_resource>> m_threadArenas;
+		std::unique_ptr<HKXStructLoader> m_loader;
+	};
+}
+
+#endif
@@ -0,0 +1,25 @@
+#ifndef HKXPARSE_HKX_EXECUTOR_H
+#define HKXPARSE_HKX_EXECUTOR_H
+
+#include <functional>
+
+namespace hkxparse {
+	/*
+	 * Runs jobs on threads of its own, such as a thread pool. Given through
+	 * HKXLoadOptions::executor, the loaders run their concurrent work on it
+	 * instead of starting threads. Jobs may run in any order, and may not
+	 * run at all before the loader is done: the loading thread takes on the
+	 * work the jobs have not got to, and never waits for a job to start.
+	 */
+	class HKXExecutor {
+	public:
+		virtual ~HKXExecutor() = default;
+
+		// Number of jobs that may run at once.
+		virtual unsigned int concurrency() const = 0;
+
+		virtual void execute(std::function<void()> &&job) = 0;
+	};
+}
+
+#endif
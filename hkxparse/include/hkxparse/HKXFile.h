@@ -2,28 +2,71 @@
 #define HKXPARSE_HKX_FILE_H
 
 #include <ios>
+#include <memory>
 #include "HKXMapping.h"
 #include "HKXTypes.h"
+#include "HKXLoadOptions.h"
+#include "HKXLoadBudget.h"
 
 namespace hkxparse {
+	class HKXDocument;
+	class HKXPackfileLoader;
+	class HKXTagfileParser;
+
+	/*
+	 * All structures reachable from root() are owned by the HKXFile and are
+	 * released together with it (or when another file is loaded into it).
+	 * root() is empty while a load is in progress.
+	 */
 	class HKXFile {
 	public:
 		HKXFile();
 		~HKXFile();
 
+		// Maps the file into memory instead of reading it; only the pages
+		// actually touched by the parser are read, and only the pages patched
+		// by packfile fixups are copied.
 		void loadFile(const char *filename);
+#ifdef _WIN32
 		void loadFile(const wchar_t *filename);
+#endif
 		void loadFile(std::istream &stream);
 		void loadFile(HKXMapping &&mapping);
 
+		/*
+		 * Incremental loading, so that a load can be interleaved with other
+		 * work: beginLoad() identifies the file, then every loadStep()
+		 * decodes objects until the budget is spent, and returns true once
+		 * root() is complete. cancelLoad() abandons a load in progress and
+		 * releases what it has decoded so far; a step that throws, or that
+		 * stops because the budget's cancellation flag is set, does the
+		 * same, so loading() tells a cancelled step from an unfinished one.
+		 * loadFile() is beginLoad() and a single unbounded step.
+		 */
+		void beginLoad(const char *filename);
+#ifdef _WIN32
+		void beginLoad(const wchar_t *filename);
+#endif
+		void beginLoad(HKXMapping &&mapping);
+		bool loadStep(const HKXLoadBudget &budget = HKXLoadBudget());
+		void cancelLoad();
+
+		inline bool loading() const { return m_packfilePending || m_packfileLoader || m_tagfileParser; }
+
 		inline const HKXStructRef &root() const { return m_root; }
 
+		// Applies to the files loaded afterwards.
+		inline const HKXLoadOptions &options() const { return m_options; }
+		inline void setOptions(const HKXLoadOptions &options) { m_options = options; }
+
 	private:
-		void doLoadFile();
-		void parsePackfile();
-		void parseTagfile();
+		void finishLoad();
 
-		HKXMapping m_mapping;
+		HKXLoadOptions m_options;
+		std::unique_ptr<HKXDocument> m_document;
+		std::unique_ptr<HKXPackfileLoader> m_packfileLoader;
+		std::unique_ptr<HKXTagfileParser> m_tagfileParser;
+		bool m_packfilePending; // identified as a packfile, loader not created yet
 		HKXStructRef m_root;
 	};
 }
@@ -0,0 +1,61 @@
+#ifndef HKXPARSE_HKX_LOAD_BUDGET_H
+#define HKXPARSE_HKX_LOAD_BUDGET_H
+
+#include <atomic>
+#include <chrono>
+#include <stddef.h>
+
+namespace hkxparse {
+	/*
+	 * Bounds one step of an incremental load (see HKXFile::beginLoad). The
+	 * step stops at the first object boundary after either limit is
+	 * reached, or after cancelled is set, possibly from another thread.
+	 * Zero limits are unbounded. Every step decodes at least one object,
+	 * unless it is cancelled, so a load always makes progress.
+	 *
+	 * Only the decoding of objects is budgeted. The first step of a
+	 * packfile load also applies all of the fixups and, unless the load is
+	 * lazy or decodeThreads is 1, decodes the objects concurrently before
+	 * it starts on its budget; that work is neither limited nor cancelled.
+	 */
+	struct HKXLoadBudget {
+		std::chrono::microseconds time = std::chrono::microseconds::zero();
+
+		// Bytes of the file decoded; for packfiles, the fixed part of each object.
+		size_t bytes = 0;
+
+		const std::atomic<bool> *cancelled = nullptr;
+	};
+
+	// Keeps track of the work done in one step against its budget.
+	class HKXBudgetTracker {
+	public:
+		explicit HKXBudgetTracker(const HKXLoadBudget &budget) : m_budget(budget), m_start(std::chrono::steady_clock::now()), m_bytes(0), m_objects(0) {}
+
+		inline void consume(size_t bytes) {
+			m_bytes += bytes;
+			m_objects++;
+		}
+
+		inline bool exhausted() const {
+			if (m_budget.cancelled && m_budget.cancelled->load(std::memory_order_relaxed))
+				return true;
+
+			if (m_objects == 0)
+				return false;
+
+			if (m_budget.bytes != 0 && m_bytes >= m_budget.bytes)
+				return true;
+
+			return m_budget.time != std::chrono::microseconds::zero() && std::chrono::steady_clock::now() - m_start >= m_budget.time;
+		}
+
+	private:
+		HKXLoadBudget m_budget;
+		std::chrono::steady_clock::time_point m_start;
+		size_t m_bytes;
+		size_t m_objects;
+	};
+}
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef HKXPARSE_HKX_LOAD_FILTER_H
+#define HKXPARSE_HKX_LOAD_FILTER_H
+
+#include <hkxparse/HKXLoadOptions.h>
+
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace hkxparse {
+	struct HKXTypeDescriptor;
+
+	/*
+	 * Applies the class filter and the field projections of HKXLoadOptions.
+	 * The decisions are made once per type and cached; thread-safe.
+	 *
+	 * The class filter only applies to objects that are referenced through
+	 * a pointer; embedded structures and the elements of arrays are loaded
+	 * if the object that holds them is.
+	 */
+	class HKXLoadFilter {
+	public:
+		explicit HKXLoadFilter(const HKXLoadOptions &options);
+		~HKXLoadFilter();
+
+		HKXLoadFilter(const HKXLoadFilter &other) = delete;
+		HKXLoadFilter &operator =(const HKXLoadFilter &other) = delete;
+
+		inline bool active() const { return m_active; }
+
+		// Whether the fields of an object of the type, referenced through a pointer, are loaded.
+		inline bool objectAllowed(const HKXTypeDescriptor *type) { return !m_active || decision(type).allowed; }
+
+		// One flag per field slot of the type, or nullptr if all fields are loaded.
+		const std::vector<bool> *fieldMask(const HKXTypeDescriptor *type);
+
+	private:
+		struct Decision {
+			bool allowed;
+			std::vector<bool> mask;
+		};
+
+		const Decision &decision(const HKXTypeDescriptor *type);
+		bool classAllowed(const HKXTypeDescriptor *type) const;
+
+		const HKXLoadOptions &m_options;
+		bool m_active;
+		std::shared_mutex m_mutex;
+		std::unordered_map<const HKXTypeDescriptor *, Decision> m_decisions;
+	};
+}
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef HKXPARSE_HKX_LOAD_OPTIONS_H
+#define HKXPARSE_HKX_LOAD_OPTIONS_H
+
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace hkxparse {
+	class HKXExecutor;
+
+	struct HKXLoadOptions {
+		/*
+		 * Primitive arrays (packfiles only) and strings are not copied into
+		 * the document, but refer directly to the file mapping, which the
+		 * document keeps alive. Strings are then stored as HKXStringView, and
+		 * arrays fall back to a copy when the data in the file is not aligned
+		 * suitably for the element type.
+		 */
+		bool zeroCopy = false;
+
+		/*
+		 * Packfiles only: structures referenced by pointers are not decoded
+		 * while loading, but on the first access through their HKXStructRef.
+		 * The loader is then kept alive by the document.
+		 */
+		bool lazy = false;
+
+		/*
+		 * Packfiles only: number of threads the pointer fixups are applied
+		 * on, including the loading thread. 0 uses one per hardware thread.
+		 */
+		unsigned int fixupThreads = 1;
+
+		/*
+		 * Packfiles only, ignored with lazy: if not 1, the objects listed in
+		 * the virtual fixup table are all decoded up front, concurrently on
+		 * this many threads (0 uses one per hardware thread), whether they
+		 * are reachable from the root or not.
+		 */
+		unsigned int decodeThreads = 1;
+
+		/*
+		 * If set, the extra threads of fixupThreads and decodeThreads are
+		 * jobs on this executor instead of threads of their own, and 0 uses
+		 * its concurrency. HKXBatchLoader sets it to its pool.
+		 */
+		HKXExecutor *executor = nullptr;
+
+		/*
+		 * Class filter. A class matches if it, or any of its parents, is
+		 * listed. The filter applies to objects, the structures referenced
+		 * through pointers: if allowedClasses is not empty, only the matching
+		 * objects are loaded, so it must also list the classes of the objects
+		 * on the path from the root (e.g. hkRootLevelContainer and
+		 * hkaAnimationContainer); objects matching deniedClasses are never
+		 * loaded. Embedded structures and the elements of arrays, such as
+		 * hkRootLevelContainerNamedVariant or hkaBone, are loaded along with
+		 * the object that holds them.
+		 *
+		 * Objects that are filtered out are still created with their type,
+		 * so references to them stay valid, but none of their fields are
+		 * loaded - and so, in packfiles, nothing they refer to is loaded
+		 * either.
+		 */
+		std::unordered_set<std::string> allowedClasses;
+		std::unordered_set<std::string> deniedClasses;
+
+		/*
+		 * Field projection: class name to the fields to load for that class
+		 * and the classes derived from it; the most derived listed class
+		 * applies. Fields that are not loaded are left as std::monostate.
+		 */
+		std::unordered_map<std::string, std::unordered_set<std::string>> fieldProjections;
+	};
+}
+
+#endif
@@ -1,11 +1,22 @@
 #ifndef HKXPARSE_HKX_MAPPING_H
 #define HKXPARSE_HKX_MAPPING_H
 
+#include <stddef.h>
+
 namespace hkxparse {
 	class HKXMapping {
 	public:
+		enum class Access {
+			ReadOnly,    // Pages are shared with the page cache and must never be written
+			CopyOnWrite  // Pages are private; written pages (e.g. packfile fixups) are copied on first write
+		};
+
 		HKXMapping() noexcept;
 		HKXMapping(size_t size);
+		explicit HKXMapping(const char *filename, Access access = Access::CopyOnWrite);
+#ifdef _WIN32
+		explicit HKXMapping(const wchar_t *filename, Access access = Access::CopyOnWrite);
+#endif
 		~HKXMapping();
 
 		HKXMapping(const HKXMapping &other) = delete;
@@ -17,15 +28,22 @@ namespace hkxparse {
 		inline operator bool() const {
 			return m_mapping;
 		}
-		
+
 		inline unsigned char *data() const { return m_mapping; }
 		inline size_t size() const { return m_size; }
 
+		inline bool isFileMapping() const { return m_fileMapping; }
+		inline bool writable() const { return m_access != Access::ReadOnly; }
+
 		void swap(HKXMapping &other) noexcept;
 
 	private:
+		void release() noexcept;
+
 		size_t m_size;
 		unsigned char *m_mapping;
+		bool m_fileMapping;
+		Access m_access;
 	};
 }
 
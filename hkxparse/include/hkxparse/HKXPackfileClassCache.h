@@ -0,0 +1,73 @@
+#ifndef HKXPARSE_HKX_PACKFILE_CLASS_CACHE_H
+#define HKXPARSE_HKX_PACKFILE_CLASS_CACHE_H
+
+#include <hkxparse/HKXTypes.h>
+#include <hkxparse/HavokReflectionTypes.h>
+
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace hkxparse {
+	class HKXPackfileDecoder;
+	struct HKXTypeDescriptor;
+	struct HavokPackfileLayout;
+
+	/*
+	 * The decoding plans of the classes of one packfile layout. There is one
+	 * cache per layout for the whole process, so the plans are built once
+	 * and shared by every loader, including the concurrent ones of
+	 * HKXBatchLoader; thread-safe. The plans live as long as the process.
+	 */
+	class HKXPackfileClassCache {
+	public:
+		using DecodeFunction = void (*)(HKXPackfileDecoder &decoder, const unsigned char *object, HKXVariant *fields);
+
+		struct ClassInfo;
+
+		struct PlanMember {
+			const HavokClassMember *member;
+			const ClassInfo *nested; // for embedded structs
+		};
+
+		/*
+		 * The serialized members of the class and of its parents, parents
+		 * first, one per field slot. Member offsets are relative to the start
+		 * of the object.
+		 */
+		struct ClassInfo {
+			const HavokClass *reflection;
+			const HKXTypeDescriptor *descriptor;
+			DecodeFunction decode;
+			bool mayHaveVtable;
+			std::vector<PlanMember> plan;
+		};
+
+		static HKXPackfileClassCache &forLayout(const HavokPackfileLayout *layout);
+
+		HKXPackfileClassCache(const HKXPackfileClassCache &other) = delete;
+		HKXPackfileClassCache &operator =(const HKXPackfileClassCache &other) = delete;
+
+		inline const HavokPackfileLayout *layout() const { return m_layout; }
+
+		const ClassInfo &classInfo(const HavokClass *classReflection);
+
+		// Both throw if the layout has no class of that name.
+		const HavokClass *findClass(const char *className) const;
+		inline const ClassInfo &classNamed(const char *className) { return classInfo(findClass(className)); }
+
+	private:
+		explicit HKXPackfileClassCache(const HavokPackfileLayout *layout);
+
+		// m_mutex must be held exclusively.
+		const ClassInfo &buildClassInfo(const HavokClass *classReflection);
+		bool classMayHaveVtable(const HavokClass *classReflection) const;
+
+		const HavokPackfileLayout *m_layout;
+		const DecodeFunction *m_decoders;
+		std::shared_mutex m_mutex;
+		std::unordered_map<const HavokClass *, ClassInfo> m_classInfo;
+	};
+}
+
+#endif
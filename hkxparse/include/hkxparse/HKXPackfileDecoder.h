@@ -0,0 +1,133 @@
+#ifndef HKXPARSE_HKX_PACKFILE_DECODER_H
+#define HKXPARSE_HKX_PACKFILE_DECODER_H
+
+#include <hkxparse/HKXTypes.h>
+#include <hkxparse/HKXPackfileLoader.h>
+#include <hkxparse/HKXMapping.h>
+#include <hkxparse/LayoutRules.h>
+#include <hkxparse/HavokReflectionTypes.h>
+
+#include <string.h>
+
+namespace hkxparse {
+	struct HavokPackfileLayout;
+
+	/*
+	 * Decoder used by the per-class decode functions generated by
+	 * make_layout.rb. Each member is decoded by decode<Type, Subtype>, so
+	 * the common member types compile down to direct loads from the
+	 * (little endian) packfile data; the rest fall back to
+	 * HKXPackfileLoader::deserializeField.
+	 */
+	class HKXPackfileDecoder {
+	public:
+		using Field = HKXVariant;
+		using Function = void (*)(HKXPackfileDecoder &decoder, const unsigned char *object, Field *fields);
+
+		HKXPackfileDecoder(HKXPackfileLoader &loader, const LayoutRules &layoutRules) : m_loader(loader), m_layoutRules(layoutRules) {}
+
+		HKXPackfileDecoder(const HKXPackfileDecoder &other) = delete;
+		HKXPackfileDecoder &operator =(const HKXPackfileDecoder &other) = delete;
+
+		// Returns the decode functions, indexed in the order of layout->classes, or nullptr if there are none for the layout.
+		static const Function *findDecoders(const HavokPackfileLayout *layout);
+
+		template<HavokType Type, HavokType Subtype>
+		inline void decode(Field &value, const unsigned char *data, const HavokClass *typeClass);
+
+	private:
+		template<typename T>
+		static inline T load(const unsigned char *data) {
+			T val;
+			memcpy(&val, data, sizeof(T));
+			return val;
+		}
+
+		inline uint64_t readPointer(const unsigned char *data) const {
+			uint64_t val;
+
+			if (m_layoutRules.bytesInPointer == 8) {
+				val = load<uint64_t>(data);
+			}
+			else {
+				val = load<uint32_t>(data);
+			}
+
+			if (!m_loader.m_patchInPlace) {
+				val = m_loader.resolvePointer(data, val);
+			}
+
+			return val;
+		}
+
+		void decodeGeneric(Field &value, const unsigned char *data, HavokType type, HavokType subtype, const HavokClass *typeClass);
+
+		HKXPackfileLoader &m_loader;
+		LayoutRules m_layoutRules;
+	};
+
+	template<HavokType Type, HavokType Subtype>
+	inline void HKXPackfileDecoder::decode(Field &value, const unsigned char *data, const HavokClass *typeClass) {
+		if constexpr (Type == HavokType::Bool) {
+			value = static_cast<uint64_t>(load<uint8_t>(data) != 0);
+		}
+		else if constexpr (Type == HavokType::Char || Type == HavokType::Int8) {
+			value = static_cast<uint64_t>(static_cast<int64_t>(load<int8_t>(data)));
+		}
+		else if constexpr (Type == HavokType::UInt8) {
+			value = static_cast<uint64_t>(load<uint8_t>(data));
+		}
+		else if constexpr (Type == HavokType::Int16) {
+			value = static_cast<uint64_t>(static_cast<int64_t>(load<int16_t>(data)));
+		}
+		else if constexpr (Type == HavokType::UInt16) {
+			value = static_cast<uint64_t>(load<uint16_t>(data));
+		}
+		else if constexpr (Type == HavokType::Int32) {
+			value = static_cast<uint64_t>(static_cast<int64_t>(load<int32_t>(data)));
+		}
+		else if constexpr (Type == HavokType::UInt32) {
+			value = static_cast<uint64_t>(load<uint32_t>(data));
+		}
+		else if constexpr (Type == HavokType::Int64 || Type == HavokType::UInt64) {
+			value = load<uint64_t>(data);
+		}
+		else if constexpr (Type == HavokType::Real) {
+			value = load<float>(data);
+		}
+		else if constexpr (Type == HavokType::Vector4) {
+			value = load<HKXVector4>(data);
+		}
+		else if constexpr (Type == HavokType::Quaternion) {
+			value = load<HKXQuaternion>(data);
+		}
+		else if constexpr (Type == HavokType::Matrix3 || Type == HavokType::Rotation) {
+			value = load<HKXMatrix3>(data);
+		}
+		else if constexpr (Type == HavokType::QsTransform) {
+			value = load<HKXQsTransform>(data);
+		}
+		else if constexpr (Type == HavokType::Matrix4 || Type == HavokType::Transform) {
+			value = load<HKXMatrix4>(data);
+		}
+		else if constexpr (Type == HavokType::Enum) {
+			decode<Subtype, HavokType::Void>(value, data, typeClass);
+		}
+		else if constexpr (Type == HavokType::Pointer && (Subtype == HavokType::Struct || Subtype == HavokType::Pointer)) {
+			if (typeClass) {
+				m_loader.linkStructure(value, m_layoutRules, readPointer(data), typeClass);
+			}
+			else {
+				decodeGeneric(value, data, Type, Subtype, typeClass);
+			}
+		}
+		else if constexpr (Type == HavokType::StringPtr) {
+			m_loader.decodeString(readPointer(data), value);
+		}
+		else {
+			decodeGeneric(value, data, Type, Subtype, typeClass);
+		}
+	}
+}
+
+#endif
@@ -2,38 +2,179 @@
 #define HKXPARSE_HKX_PACKFILE_LOADER_H
 
 #include <hkxparse/HKXTypes.h>
+#include <hkxparse/HKXLoadOptions.h>
+#include <hkxparse/HKXLoadFilter.h>
+#include <hkxparse/HKXLoadBudget.h>
+#include <hkxparse/HKXMapping.h>
+#include <hkxparse/HKXPackfileClassCache.h>
+#include <hkxparse/Deserializer.h>
 #include <hkxparse/HavokReflectionTypes.h>
 
+#include <vector>
+#include <unordered_map>
+#include <mutex>
+#include <shared_mutex>
+
 namespace hkxparse {
-	class HKXMapping;
+	class HKXDocument;
+	class HKXPackfileDecoder;
 	struct LayoutRules;
 	struct HavokPackfileLayout;
-	class Deserializer;
 
-	class HKXPackfileLoader {
+	/*
+	 * Fixups are patched into a writable mapping, or, for a read-only one,
+	 * resolved through an index on every read, leaving the mapping intact.
+	 * With HKXLoadOptions::lazy, the loader must outlive the structures it
+	 * returns; see HKXDocument::retainLoader. loadRoot() decodes the whole
+	 * graph; beginLoad() and loadStep() do it in budgeted steps instead.
+	 */
+	class HKXPackfileLoader final : public HKXStructLoader {
 	public:
-		explicit HKXPackfileLoader(HKXMapping &mapping);
-		~HKXPackfileLoader();
+		HKXPackfileLoader(HKXMapping &mapping, HKXDocument &document, const HKXLoadOptions &options = HKXLoadOptions());
+		~HKXPackfileLoader() override;
 
 		HKXPackfileLoader(const HKXPackfileLoader &other) = delete;
 		HKXPackfileLoader &operator =(const HKXPackfileLoader &other) = delete;
 
 		HKXStructRef loadRoot();
 
+		void beginLoad();
+		bool loadStep(const HKXLoadBudget &budget);
+		inline const HKXStructRef &root() const { return m_root; }
+
+		// Zero-copy view of the root object (<layout>_views.h); needs a writable mapping.
+		template<typename View>
+		View rootView() const {
+			return View(m_mapping.data(), rootObject(View::reflection()));
+		}
+
+		void materialize(HKXStruct &target) override;
+
 	private:
-		void fixup(unsigned char *data, size_t dataSize, const LayoutRules &layoutRules, size_t offset, size_t target);
-		void parseStructure(const char *className, Deserializer &stream, HKXStruct &target);
-		void parseStructure(const HavokClass *classReflection, Deserializer &stream, HKXStruct &target, bool nested = false);
-		void deserializeField(Deserializer &stream, const HavokClassMember &member, HKXVariant &value); 
-		void deserializeField(Deserializer &stream, const HavokClassMember &member, HavokType type, HKXVariant &value);
-		bool classMayHaveVtable(const HavokClass *classReflection) const;
+		friend class HKXPackfileDecoder;
+
+		// Only little endian packfiles are loaded.
+		using Stream32 = BasicDeserializer<1, 4>;
+		using Stream64 = BasicDeserializer<1, 8>;
+
+		using ClassInfo = HKXPackfileClassCache::ClassInfo;
+
+		struct Fixup {
+			uint32_t offset;
+			uint32_t target;
+		};
+
+		struct SectionFixups {
+			uint32_t dataStart;
+			uint32_t dataEnd;
+			std::vector<Fixup> fixups;
+		};
+
+		// A structure that has been allocated, but is yet to be decoded
+		struct PendingObject {
+			uint64_t offset;
+			const HavokClass *classReflection;
+			HKXStructRef target;
+
+			inline bool operator >(const PendingObject &other) const { return offset > other.offset; }
+		};
+
+		// An object listed in the virtual fixup table
+		struct VirtualObject {
+			uint64_t offset;
+			uint64_t className; // file offset of the class name
+		};
+
+		enum class FixupKind {
+			Local,
+			Global,
+			Virtual
+		};
+
+		// A chunk of the fixup table of a section
+		struct FixupTask {
+			int32_t sectionIndex;
+			FixupKind kind;
+			const unsigned char *entries;
+			size_t count;
+			std::vector<Fixup> collected; // if not patching in place; merged into m_fixupIndex afterwards
+		};
+
+		static void addFixupTasks(std::vector<FixupTask> &tasks, int32_t sectionIndex, FixupKind kind, const unsigned char *entries, size_t count);
+		void applyFixups(FixupTask &task) const;
+		void fixup(FixupTask &task, unsigned char *data, size_t dataSize, const LayoutRules &layoutRules, size_t offset, uint64_t target) const;
+
+		template<typename PointerType>
+		static void patchLocalFixups(unsigned char *data, size_t dataSize, uint64_t base, const uint32_t *entries, size_t count);
+
+		const ClassInfo &classAtOffset(uint64_t nameOffset);
+		const unsigned char *rootObject(const HavokClass *viewClass) const;
+
+		// referenced is set for objects reached through a pointer, which the class filter applies to.
+		template<typename Stream>
+		void parseStructure(const HavokClass *classReflection, Stream &stream, HKXStruct &target, bool referenced);
+
+		template<typename Stream>
+		void parseStructure(const ClassInfo *info, Stream &stream, HKXStruct &target, bool referenced);
+
+		template<typename Stream>
+		void parseMembers(const ClassInfo &info, Stream &stream, HKXStruct &target, const std::vector<bool> *fieldMask);
+
+		inline const ClassInfo &classInfo(const HavokClass *classReflection) { return m_classes->classInfo(classReflection); }
+
+		template<typename Stream>
+		void deserializeField(Stream &stream, const HavokClassMember &member, HKXVariant &value);
+
+		template<typename Stream>
+		void deserializeField(Stream &stream, const HavokClassMember &member, HavokType type, HKXVariant &value);
+
+		void decodeString(uint64_t pointer, HKXVariant &value);
+
+		template<typename Stream>
+		void readPointer(Stream &stream, uint64_t &val) const;
+
+		uint64_t resolvePointer(const unsigned char *slot, uint64_t rawValue) const;
+
+		template<typename Stream, typename T>
+		void readArray(Stream &stream, size_t count, HKXTypedArray<T> &ary) const;
+
+		// Calls function with a stream over data of the pointer width in layoutRules.
+		template<typename Function>
+		static void withStream(const LayoutRules &layoutRules, const unsigned char *data, size_t dataSize, Function &&function) {
+			if (layoutRules.bytesInPointer == 4) {
+				Stream32 stream(layoutRules, data, dataSize);
+				function(stream);
+			}
+			else if (layoutRules.bytesInPointer == 8) {
+				Stream64 stream(layoutRules, data, dataSize);
+				function(stream);
+			}
+			else {
+				throwDeserializerError("unsupported pointer length");
+			}
+		}
 
-		template<typename ClassArgType>
-		HKXStructRef parseStructureAtPointer(const LayoutRules &layoutRules, uint64_t pointer, ClassArgType classArg);
+		HKXStructRef parseStructureAtPointer(const LayoutRules &layoutRules, uint64_t pointer, const HavokClass *classReflection);
+		HKXStructRef queueStructure(uint64_t pointer, const HavokClass *classReflection);
+		bool decodePending(const LayoutRules &layoutRules, HKXBudgetTracker &tracker);
+		void linkStructure(HKXVariant &value, const LayoutRules &layoutRules, uint64_t pointer, const HavokClass *classReflection);
+		void decodeObjects(unsigned int threads);
 
 		HKXMapping &m_mapping;
-		const HavokPackfileLayout *m_layout;
+		HKXDocument &m_document;
+		HKXLoadOptions m_options;
+		HKXLoadFilter m_filter;
+		HKXPackfileClassCache *m_classes;
+		bool m_patchInPlace;
+		std::vector<SectionFixups> m_fixupIndex;
 		std::unordered_map<uint64_t, HKXStructRef> m_structures;
+		std::vector<PendingObject> m_pending; // heap, lowest offset first
+		bool m_decodingPending;
+		HKXStructRef m_root;
+		std::vector<VirtualObject> m_virtualObjects;
+		std::shared_mutex m_classMutex; // guards m_namedClasses
+		std::unordered_map<uint64_t, const ClassInfo *> m_namedClasses; // by the file offset of the class name
+		std::mutex m_lazyMutex;
 	};
 }
 
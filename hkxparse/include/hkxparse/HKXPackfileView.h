@@ -0,0 +1,181 @@
+#ifndef HKXPARSE_HKX_PACKFILE_VIEW_H
+#define HKXPARSE_HKX_PACKFILE_VIEW_H
+
+#include <hkxparse/HKXTypes.h>
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+namespace hkxparse {
+	/*
+	 * Support for the typed views generated by make_layout.rb
+	 * (<layout>_views.h). A view is a pair of the packfile base address and
+	 * an object address; its accessors read the members straight from the
+	 * packfile memory, at the offsets given by the layout, without
+	 * allocating anything.
+	 *
+	 * Pointers in the packfile are offsets from the base address, so views
+	 * are only valid over a packfile whose fixups were applied in place;
+	 * see HKXPackfileLoader::rootView.
+	 */
+
+	template<typename T>
+	class HKXPackfileArray {
+	public:
+		using value_type = T;
+
+		inline HKXPackfileArray() : m_data(nullptr), m_size(0) {}
+		inline HKXPackfileArray(const unsigned char *data, size_t size) : m_data(data), m_size(size) {}
+
+		inline size_t size() const { return m_size; }
+		inline bool empty() const { return m_size == 0; }
+
+		inline T operator [](size_t index) const {
+			T val;
+			memcpy(&val, m_data + index * sizeof(T), sizeof(T));
+			return val;
+		}
+
+		// The elements are laid out contiguously, but not necessarily aligned for T.
+		inline const T *data() const { return reinterpret_cast<const T *>(m_data); }
+
+	private:
+		const unsigned char *m_data;
+		size_t m_size;
+	};
+
+	template<typename View>
+	class HKXPackfileStructArray {
+	public:
+		using value_type = View;
+
+		inline HKXPackfileStructArray() : m_base(nullptr), m_data(nullptr), m_size(0) {}
+		inline HKXPackfileStructArray(const unsigned char *base, const unsigned char *data, size_t size) : m_base(base), m_data(data), m_size(size) {}
+
+		inline size_t size() const { return m_size; }
+		inline bool empty() const { return m_size == 0; }
+
+		inline View operator [](size_t index) const { return View(m_base, m_data + index * View::objectSize); }
+
+	private:
+		const unsigned char *m_base;
+		const unsigned char *m_data;
+		size_t m_size;
+	};
+
+	// Elements are pointers; View is either a view type, or const char * for arrays of strings.
+	template<typename View, typename PointerType>
+	class HKXPackfilePointerArray {
+	public:
+		using value_type = View;
+
+		inline HKXPackfilePointerArray() : m_base(nullptr), m_data(nullptr), m_size(0) {}
+		inline HKXPackfilePointerArray(const unsigned char *base, const unsigned char *data, size_t size) : m_base(base), m_data(data), m_size(size) {}
+
+		inline size_t size() const { return m_size; }
+		inline bool empty() const { return m_size == 0; }
+
+		inline View operator [](size_t index) const {
+			PointerType pointer;
+			memcpy(&pointer, m_data + index * sizeof(PointerType), sizeof(PointerType));
+
+			auto target = pointer ? m_base + pointer : nullptr;
+
+			if constexpr (std::is_same_v<View, const char *>) {
+				return reinterpret_cast<const char *>(target);
+			}
+			else {
+				return View(m_base, target);
+			}
+		}
+
+	private:
+		const unsigned char *m_base;
+		const unsigned char *m_data;
+		size_t m_size;
+	};
+
+	template<typename PointerType>
+	class HKXPackfileObjectView {
+	public:
+		inline HKXPackfileObjectView() : m_base(nullptr), m_object(nullptr) {}
+		inline HKXPackfileObjectView(const unsigned char *base, const unsigned char *object) : m_base(base), m_object(object) {}
+
+		inline explicit operator bool() const { return m_object != nullptr; }
+
+		inline const unsigned char *objectData() const { return m_object; }
+
+		// Unchecked conversion, e.g. to the view of the actual class of a polymorphic object.
+		template<typename View>
+		inline View viewAs() const { return View(m_base, m_object); }
+
+	protected:
+		template<typename T>
+		inline T readValue(size_t offset) const {
+			T val;
+			memcpy(&val, m_object + offset, sizeof(T));
+			return val;
+		}
+
+		inline bool readBool(size_t offset) const {
+			return m_object[offset] != 0;
+		}
+
+		inline const unsigned char *readPointer(size_t offset) const {
+			auto pointer = readValue<PointerType>(offset);
+			return pointer ? m_base + pointer : nullptr;
+		}
+
+		template<typename View>
+		inline View readObject(size_t offset) const {
+			return View(m_base, readPointer(offset));
+		}
+
+		template<typename View>
+		inline View readStruct(size_t offset) const {
+			return View(m_base, m_object + offset);
+		}
+
+		inline const char *readString(size_t offset) const {
+			return reinterpret_cast<const char *>(readPointer(offset));
+		}
+
+		// hkArray: pointer, then 32-bit size
+		inline size_t readArraySize(size_t offset) const {
+			return readValue<uint32_t>(offset + sizeof(PointerType));
+		}
+
+		template<typename T>
+		inline HKXPackfileArray<T> readArray(size_t offset) const {
+			return HKXPackfileArray<T>(readPointer(offset), readArraySize(offset));
+		}
+
+		template<typename View>
+		inline HKXPackfileStructArray<View> readStructArray(size_t offset) const {
+			return HKXPackfileStructArray<View>(m_base, readPointer(offset), readArraySize(offset));
+		}
+
+		template<typename View>
+		inline HKXPackfilePointerArray<View, PointerType> readPointerArray(size_t offset) const {
+			return HKXPackfilePointerArray<View, PointerType>(m_base, readPointer(offset), readArraySize(offset));
+		}
+
+		// Arrays embedded in the object (members with arraySize)
+		template<typename T>
+		inline HKXPackfileArray<T> readInlineArray(size_t offset, size_t size) const {
+			return HKXPackfileArray<T>(m_object + offset, size);
+		}
+
+		template<typename View>
+		inline HKXPackfileStructArray<View> readInlineStructArray(size_t offset, size_t size) const {
+			return HKXPackfileStructArray<View>(m_base, m_object + offset, size);
+		}
+
+		const unsigned char *m_base;
+		const unsigned char *m_object;
+	};
+}
+
+#endif
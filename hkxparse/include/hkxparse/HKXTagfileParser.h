@@ -5,46 +5,123 @@
 #include <hkxparse/LayoutRules.h>
 #include <hkxparse/Deserializer.h>
 #include <hkxparse/TagfileTypes.h>
+#include <hkxparse/HKXLoadOptions.h>
+#include <hkxparse/HKXLoadFilter.h>
+#include <hkxparse/HKXLoadBudget.h>
 #include <array>
+#include <deque>
+#include <type_traits>
+#include <unordered_map>
 
 namespace hkxparse {
 	class HKXMapping;
+	class HKXDocument;
 
+	/*
+	 * parse() decodes the whole file. Alternatively, the file may be decoded
+	 * incrementally, one top level tag at a time, by calling parseStep()
+	 * until it returns true; root() is then the root object. A parser that
+	 * has thrown cannot be resumed.
+	 */
 	class HKXTagfileParser {
 	public:
-		explicit HKXTagfileParser(HKXMapping &mapping);
+		HKXTagfileParser(HKXMapping &mapping, HKXDocument &document, const HKXLoadOptions &options = HKXLoadOptions());
 		~HKXTagfileParser();
 
 		HKXTagfileParser(const HKXTagfileParser &other) = delete;
 		HKXTagfileParser &operator =(const HKXTagfileParser &other) = delete;
 
 		HKXStructRef parse();
+		bool parseStep(const HKXLoadBudget &budget);
+
+		inline const HKXStructRef &root() const { return m_root; }
 
 	private:
 		using MemberBitmap = std::array<uint8_t, 16>;
 
-		const std::string &readString();
+		// Tagfiles hold no pointers; parse() picks the stream matching the byte order of the file once.
+		using LittleStream = BasicDeserializer<1, 0>;
+		using BigStream = BasicDeserializer<0, 0>;
+
+		template<typename Stream>
+		inline Stream &stream() {
+			if constexpr (std::is_same_v<Stream, LittleStream>) {
+				return m_littleStream;
+			}
+			else {
+				return m_bigStream;
+			}
+		}
+
+		template<typename Stream>
+		bool parseObjects(HKXBudgetTracker &tracker);
+
+		template<typename Stream>
+		std::string_view readString();
+
+		template<typename Stream>
 		TagfileTypeInfo readTypeInfo();
 
-		void parseStruct(HKXStruct &st, int32_t classIndex);
-		void parseStructMembers(HKXStruct &st, const MemberBitmap &bitmap, size_t &firstIndex, const TagfileTypeInfo &typeInfo);
-		void parseField(HKXStruct &st, const TagfileMemberInfo &member);
-		void parseFieldValue(unsigned int type, const std::string &className, HKXVariant &value, int32_t arrayPrefix);
-		size_t countMembers(int32_t classIndex);
-		void parseStructArray(const TagfileMemberInfo &member, HKXArray &ary);
+		HKXStructRef &objectSlot(int32_t objectIndex);
+
+		void flattenMembers(int32_t classIndex);
+		int32_t memberClass(const TagfileFlatMember &member) const;
+		const HKXTypeDescriptor *typeDescriptor(int32_t classIndex);
+
+		template<typename Stream>
+		void parseStruct(HKXStruct &st, int32_t classIndex, bool referenced);
+
+		template<typename Stream>
+		void parseField(HKXVariant &value, const TagfileFlatMember &member);
+
+		template<typename Stream>
+		void parseFieldValue(unsigned int type, const TagfileFlatMember &member, HKXVariant &value, int32_t arrayPrefix);
+
+		template<typename Stream>
+		void parseStructArray(const TagfileFlatMember &member, size_t count, HKXStructArray &ary);
+
+		template<typename Stream>
 		int32_t parseArrayPrefix(unsigned int type);
-		const TagfileMemberInfo *structMemberByIndex(const TagfileTypeInfo &typeInfo, size_t index, size_t *firstIndex = nullptr);
-		void parseArray(const TagfileMemberInfo &member, HKXArray &ary);
+
+		template<typename Stream>
+		void parseArray(const TagfileFlatMember &member, size_t count, HKXVariant &value);
+
+		template<typename Stream>
+		int32_t readStructArrayClass(const TagfileFlatMember &member);
+
+		template<typename Stream>
+		size_t readMemberBitmap(int32_t classIndex, MemberBitmap &bitmap);
+
+		// Consume the data of the fields dropped by the load filter without materializing it.
+		template<typename Stream>
+		void skipStruct(int32_t classIndex);
+
+		template<typename Stream>
+		void skipField(const TagfileFlatMember &member);
+
+		template<typename Stream>
+		void skipArray(const TagfileFlatMember &member, size_t count);
+
+		template<typename Stream>
+		void skipFieldValue(unsigned int type, const TagfileFlatMember &member, int32_t arrayPrefix);
 
 		HKXMapping &m_mapping;
+		HKXDocument &m_document;
+		HKXLoadOptions m_options;
+		HKXLoadFilter m_filter;
 		LayoutRules m_rules;
-		Deserializer m_stream;
-		std::vector<std::string> m_stringPool;
-		std::string m_havokVersion;
-		std::vector<TagfileTypeInfo> m_types;
-		std::unordered_map<std::string, int32_t> m_typeLookup;
+		LittleStream m_littleStream;
+		BigStream m_bigStream;
+		std::vector<std::string_view> m_stringPool; // views of the mapping
+		std::string_view m_havokVersion;
+		std::deque<TagfileTypeInfo> m_types; // a deque, as allMembers points into the members of other types
+		std::unordered_map<std::string_view, int32_t> m_typeLookup;
+		std::vector<const HKXTypeDescriptor *> m_typeDescriptors;
 		int32_t m_nextAllocatedObject;
-		std::unordered_map<int32_t, std::shared_ptr<HKXStruct>> m_objects;
+		std::vector<HKXStructRef> m_objects; // by object id; ids are allocated sequentially from 1
+		std::vector<int32_t> m_forwardReferences; // ids referenced before they were defined
+		HKXStructRef m_root;
+		bool m_finished;
 	};
 }
 
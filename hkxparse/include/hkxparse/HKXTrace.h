@@ -0,0 +1,16 @@
+#ifndef HKXPARSE_HKX_TRACE_H
+#define HKXPARSE_HKX_TRACE_H
+
+/*
+ * Progress messages of the loaders, printed to stdout for every section,
+ * object and field. They are only compiled in with HKXPARSE_TRACE.
+ */
+#ifdef HKXPARSE_TRACE
+#include <stdio.h>
+
+#define HKX_TRACE(...) printf(__VA_ARGS__)
+#else
+#define HKX_TRACE(...) ((void)0)
+#endif
+
+#endif
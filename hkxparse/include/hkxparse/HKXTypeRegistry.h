@@ -0,0 +1,89 @@
+#ifndef HKXPARSE_HKX_TYPE_REGISTRY_H
+#define HKXPARSE_HKX_TYPE_REGISTRY_H
+
+#include <hkxparse/HKXTypes.h>
+
+#include <memory_resource>
+#include <shared_mutex>
+#include <string_view>
+#include <unordered_set>
+#include <unordered_map>
+#include <vector>
+#include <memory>
+
+namespace hkxparse {
+	/*
+	 * Interned class or field name. Two symbols are equal if and only if
+	 * they point to the same interned string, so comparing them is a
+	 * pointer comparison.
+	 */
+	class HKXSymbol {
+	public:
+		constexpr HKXSymbol() noexcept : m_name(nullptr) {}
+
+		inline const char *c_str() const { return m_name; }
+
+		inline explicit operator bool() const { return m_name != nullptr; }
+
+		inline bool operator ==(const HKXSymbol &other) const { return m_name == other.m_name; }
+		inline bool operator !=(const HKXSymbol &other) const { return m_name != other.m_name; }
+
+	private:
+		friend class HKXTypeRegistry;
+
+		explicit HKXSymbol(const char *name) noexcept : m_name(name) {}
+
+		const char *m_name;
+	};
+
+	/*
+	 * Describes one concrete struct type: its inheritance chain (root class
+	 * first) and its field slots (all members of the class and of its
+	 * parents, parents first, in declaration order). Descriptors are interned
+	 * in HKXTypeRegistry and shared by all instances in all loaded files.
+	 */
+	struct HKXTypeDescriptor {
+		static constexpr size_t npos = ~static_cast<size_t>(0);
+
+		std::vector<HKXSymbol> classNames;
+		std::vector<HKXSymbol> fieldNames;
+		std::vector<uint32_t> fieldHashes;
+
+		inline HKXSymbol name() const { return classNames.back(); }
+		inline size_t fieldCount() const { return fieldNames.size(); }
+
+		bool isA(HKXSymbol className) const;
+
+		// Meant to be resolved once per type and then reused as an index into HKXStruct::fields.
+		size_t fieldIndex(const HKXFieldName &name) const;
+		size_t fieldIndex(HKXSymbol name) const;
+	};
+
+	class HKXTypeRegistry {
+	public:
+		static HKXTypeRegistry &instance();
+
+		HKXTypeRegistry(const HKXTypeRegistry &other) = delete;
+		HKXTypeRegistry &operator =(const HKXTypeRegistry &other) = delete;
+
+		HKXSymbol intern(const char *name);
+		HKXSymbol intern(std::string_view name);
+
+		const HKXTypeDescriptor *internType(const std::vector<HKXSymbol> &classNames, const std::vector<HKXSymbol> &fieldNames);
+
+	private:
+		struct TypeKeyHash {
+			size_t operator()(const std::vector<const char *> &key) const;
+		};
+
+		HKXTypeRegistry();
+		~HKXTypeRegistry();
+
+		std::shared_mutex m_mutex;
+		std::pmr::monotonic_buffer_resource m_strings;
+		std::unordered_set<std::string_view> m_symbols;
+		std::unordered_map<std::vector<const char *>, std::unique_ptr<HKXTypeDescriptor>, TypeKeyHash> m_types;
+	};
+}
+
+#endif
@@ -1,17 +1,20 @@
 #ifndef HKXPARSE_HKX_TYPES_H
 #define HKXPARSE_HKX_TYPES_H
 
-#include <memory>
+#include <atomic>
+#include <memory_resource>
 #include <variant>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <vector>
+#include <stdint.h>
 
-namespace hkxparse {
-	class Deserializer;
+#include <hkxparse/Deserializer.h>
 
+namespace hkxparse {
 	struct HKXStruct;
 
-	struct HKXVector4 {
+	struct alignas(16) HKXVector4 {
 		float x;
 		float y;
 		float z;
@@ -37,8 +40,57 @@ namespace hkxparse {
 	};
 
 	struct HKXArray;
+	struct HKXStructArray;
+	class HKXStructArrayRow;
+	struct HKXTypeDescriptor;
+	struct HKXLazyState;
+
+	template<typename T>
+	class HKXTypedArray;
+
+	using HKXAllocator = std::pmr::polymorphic_allocator<std::byte>;
+	using HKXString = std::pmr::string;
+	using HKXStringView = std::string_view;
+
+	using HKXByteArray = HKXTypedArray<unsigned char>;
+
+	using HKXRealArray = HKXTypedArray<float>;
+	using HKXIntArray = HKXTypedArray<int32_t>;
+	using HKXUIntArray = HKXTypedArray<uint32_t>;
+	using HKXVector4Array = HKXTypedArray<HKXVector4>;
+	using HKXQuaternionArray = HKXTypedArray<HKXQuaternion>;
+	using HKXMatrix3Array = HKXTypedArray<HKXMatrix3>;
+	using HKXQsTransformArray = HKXTypedArray<HKXQsTransform>;
+	using HKXMatrix4Array = HKXTypedArray<HKXMatrix4>;
+
+	/*
+	 * Non-owning handle to a structure living in an HKXDocument. It stays
+	 * valid for as long as the document (i.e. the HKXFile) that produced it.
+	 *
+	 * If the structure was loaded lazily, it is decoded on the first access
+	 * through get(), * or ->, from whichever thread gets there first.
+	 * Comparing handles or testing them for null never decodes anything.
+	 */
+	class HKXStructRef {
+	public:
+		inline HKXStructRef() noexcept : m_struct(nullptr) {}
+		inline explicit HKXStructRef(HKXStruct *st) noexcept : m_struct(st) {}
+
+		inline HKXStruct *get() const;
+		inline HKXStruct &operator *() const { return *get(); }
+		inline HKXStruct *operator ->() const { return get(); }
+
+		inline bool isMaterialized() const;
+
+		inline explicit operator bool() const { return m_struct != nullptr; }
+
+		inline bool operator ==(const HKXStructRef &other) const { return m_struct == other.m_struct; }
+		inline bool operator !=(const HKXStructRef &other) const { return m_struct != other.m_struct; }
+
+	private:
+		HKXStruct *m_struct;
+	};
 
-	using HKXStructRef = std::shared_ptr<HKXStruct>;
 	using HKXVariant = std::variant< // Variant
 		std::monostate,
 		uint64_t, // Bool, Char, Int8, UInt8, Int16, UInt16, Int32, UInt32, Int64, UInt64, Enum, Flags, ULong
@@ -50,25 +102,261 @@ namespace hkxparse {
 		HKXMatrix4, // Matrix4, Transform
 		HKXStructRef, // Pointer (some types of)
 		HKXArray, // Array, InPlaceArray, SimpleArray, HomogeneousArray, RelArray
-		std::string, // CString, StringPtr
+		HKXString, // CString, StringPtr
 		HKXStruct, // Struct
-		std::vector<unsigned char> // Arrays of Int8, UInt8
+		HKXByteArray, // Arrays of Int8, UInt8
+		HKXRealArray, // Arrays of Real, Half
+		HKXIntArray, // Arrays of Int16, UInt16, Int32
+		HKXUIntArray, // Arrays of UInt32
+		HKXVector4Array, // Arrays of Vector4
+		HKXQuaternionArray, // Arrays of Quaternion
+		HKXMatrix3Array, // Arrays of Matrix3, Rotation
+		HKXQsTransformArray, // Arrays of QsTransform
+		HKXMatrix4Array, // Arrays of Matrix4, Transform
+		HKXStringView, // StringPtr, CString, when loaded with HKXLoadOptions::zeroCopy
+		HKXStructArray // Arrays of Struct in tagfiles
 	>;
 
+	/*
+	 * Field name with its hash computed at compile time when constructed
+	 * from a literal. Used to look up field slots without hashing strings.
+	 */
+	class HKXFieldName {
+	public:
+		constexpr HKXFieldName(const char *name) : m_name(name), m_hash(hash(name)) {}
+
+		constexpr const char *name() const { return m_name; }
+		constexpr uint32_t hash() const { return m_hash; }
+
+		static constexpr uint32_t hash(const char *name) {
+			uint32_t value = 2166136261U;
+
+			while (*name) {
+				value = (value ^ static_cast<unsigned char>(*name++)) * 16777619U;
+			}
+
+			return value;
+		}
+
+	private:
+		const char *m_name;
+		uint32_t m_hash;
+	};
+
 	struct HKXStruct {
-		std::vector<std::string> classNames;
-		std::unordered_map<std::string, HKXVariant> fields;
+		HKXStruct() = default;
+		explicit HKXStruct(const HKXAllocator &allocator) : fields(allocator) {}
+
+		void setType(const HKXTypeDescriptor *descriptor);
+
+		const HKXVariant *field(const HKXFieldName &name) const;
+		HKXVariant *field(const HKXFieldName &name);
+
+		const HKXTypeDescriptor *type = nullptr; // Interned in HKXTypeRegistry, see HKXTypeRegistry.h
+		std::pmr::vector<HKXVariant> fields; // Indexed by type slot; absent fields are std::monostate
+		HKXLazyState *lazy = nullptr; // Only for lazily loaded structures, see HKXStructRef
 	};
 
+	/*
+	 * Implemented by the loaders that are able to defer decoding of the
+	 * structures until they are accessed. materialize() must be thread-safe.
+	 */
+	class HKXStructLoader {
+	public:
+		virtual ~HKXStructLoader() = default;
+
+		virtual void materialize(HKXStruct &target) = 0;
+	};
+
+	struct HKXLazyState {
+		HKXLazyState(HKXStructLoader *loader, uint64_t offset, const void *typeInfo) : loader(loader), offset(offset), typeInfo(typeInfo), materialized(false) {}
+
+		HKXStructLoader *loader;
+		uint64_t offset; // Location of the structure, as understood by the loader
+		const void *typeInfo; // Class of the structure, as understood by the loader
+		std::atomic<bool> materialized;
+	};
+
+	inline HKXStruct *HKXStructRef::get() const {
+		if (m_struct && m_struct->lazy && !m_struct->lazy->materialized.load(std::memory_order_acquire)) {
+			m_struct->lazy->loader->materialize(*m_struct);
+		}
+
+		return m_struct;
+	}
+
+	inline bool HKXStructRef::isMaterialized() const {
+		return !m_struct || !m_struct->lazy || m_struct->lazy->materialized.load(std::memory_order_acquire);
+	}
+
 	struct HKXArray {
-		std::vector<HKXVariant> values;
+		HKXArray() = default;
+		explicit HKXArray(const HKXAllocator &allocator) : values(allocator) {}
+
+		std::pmr::vector<HKXVariant> values;
+	};
+
+	/*
+	 * Array of structures stored by column, as tagfiles store them: each
+	 * column holds one field for all of the rows. Columns of Byte, Int,
+	 * Real and vector fields are the matching typed arrays, columns of
+	 * struct fields are nested HKXStructArrays, and columns of the other
+	 * fields are HKXArrays. Columns are indexed by type slot; absent fields
+	 * are std::monostate.
+	 *
+	 * field() gives a value in the representation HKXStruct uses for the
+	 * same field, and row() a view of one row that reads the columns on
+	 * access. Neither allocates from the document; a nested struct field
+	 * read through field() is allocated with the given allocator.
+	 */
+	struct HKXStructArray {
+		HKXStructArray() = default;
+		explicit HKXStructArray(const HKXAllocator &allocator) : columns(allocator) {}
+
+		void setType(const HKXTypeDescriptor *descriptor, size_t rowCount);
+
+		inline size_t size() const { return count; }
+		inline bool empty() const { return count == 0; }
+
+		const HKXVariant *column(const HKXFieldName &name) const;
+
+		HKXVariant field(size_t row, size_t slot, const HKXAllocator &allocator = HKXAllocator()) const;
+		HKXVariant field(size_t row, const HKXFieldName &name, const HKXAllocator &allocator = HKXAllocator()) const;
+		inline HKXStructArrayRow row(size_t row) const;
+
+		const HKXTypeDescriptor *type = nullptr; // Interned in HKXTypeRegistry, see HKXTypeRegistry.h
+		size_t count = 0;
+		std::pmr::vector<HKXVariant> columns;
+	};
+
+	/*
+	 * Array of numeric or vector elements stored contiguously in their
+	 * natural representation, instead of one HKXVariant per element.
+	 * The elements are either owned by the array, or, for zero-copy loads,
+	 * are a view into the file mapping.
+	 */
+	template<typename T>
+	class HKXTypedArray {
+	public:
+		using value_type = T;
+
+		HKXTypedArray() : m_view(nullptr), m_viewSize(0) {}
+		explicit HKXTypedArray(const HKXAllocator &allocator) : m_view(nullptr), m_viewSize(0), m_storage(allocator) {}
+
+		inline const T *data() const { return m_view ? m_view : m_storage.data(); }
+		inline size_t size() const { return m_view ? m_viewSize : m_storage.size(); }
+		inline bool empty() const { return size() == 0; }
+		inline bool isView() const { return m_view != nullptr; }
+
+		inline const T &operator [](size_t index) const { return data()[index]; }
+
+		inline const T *begin() const { return data(); }
+		inline const T *end() const { return data() + size(); }
+
+		// Used by the loaders to fill the array.
+		inline std::pmr::vector<T> &storage() { return m_storage; }
+
+		inline void setView(const T *data, size_t size) {
+			m_storage.clear();
+			m_view = data;
+			m_viewSize = size;
+		}
+
+	private:
+		const T *m_view;
+		size_t m_viewSize;
+		std::pmr::vector<T> m_storage;
 	};
 
-	Deserializer &operator >>(Deserializer &stream, HKXVector4 &val);
-	Deserializer &operator >>(Deserializer &stream, HKXQuaternion &val);
-	Deserializer &operator >>(Deserializer &stream, HKXMatrix3 &val);
-	Deserializer &operator >>(Deserializer &stream, HKXQsTransform &val);
-	Deserializer &operator >>(Deserializer &stream, HKXMatrix4 &val);
+	// One row of an HKXStructArray; valid for as long as the array is.
+	class HKXStructArrayRow {
+	public:
+		inline HKXStructArrayRow(const HKXStructArray &array, size_t row) : m_array(&array), m_row(row) {}
+
+		inline const HKXTypeDescriptor *type() const { return m_array->type; }
+		inline size_t index() const { return m_row; }
+
+		// Nested struct fields are columns of their own; these read them without allocating.
+		inline bool isNested(size_t slot) const { return std::holds_alternative<HKXStructArray>(m_array->columns[slot]); }
+		inline HKXStructArrayRow nested(size_t slot) const { return HKXStructArrayRow(std::get<HKXStructArray>(m_array->columns[slot]), m_row); }
+
+		inline HKXVariant field(size_t slot, const HKXAllocator &allocator = HKXAllocator()) const { return m_array->field(m_row, slot, allocator); }
+		inline HKXVariant field(const HKXFieldName &name, const HKXAllocator &allocator = HKXAllocator()) const { return m_array->field(m_row, name, allocator); }
+
+		HKXStruct materialize(const HKXAllocator &allocator = HKXAllocator()) const;
+
+	private:
+		const HKXStructArray *m_array;
+		size_t m_row;
+	};
+
+	inline HKXStructArrayRow HKXStructArray::row(size_t row) const {
+		return HKXStructArrayRow(*this, row);
+	}
+
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	inline BasicDeserializer<LittleEndian, BytesInPointer> &operator >>(BasicDeserializer<LittleEndian, BytesInPointer> &stream, HKXVector4 &val) {
+		return stream >> val.x >> val.y >> val.z >> val.w;
+	}
+
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	inline BasicDeserializer<LittleEndian, BytesInPointer> &operator >>(BasicDeserializer<LittleEndian, BytesInPointer> &stream, HKXQuaternion &val) {
+		return stream >> val.vec;
+	}
+
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	inline BasicDeserializer<LittleEndian, BytesInPointer> &operator >>(BasicDeserializer<LittleEndian, BytesInPointer> &stream, HKXMatrix3 &val) {
+		return stream >> val.v[0] >> val.v[1] >> val.v[2];
+	}
+
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	inline BasicDeserializer<LittleEndian, BytesInPointer> &operator >>(BasicDeserializer<LittleEndian, BytesInPointer> &stream, HKXQsTransform &val) {
+		return stream >> val.translation >> val.rotation >> val.scale;
+	}
+
+	template<unsigned int LittleEndian, unsigned int BytesInPointer>
+	inline BasicDeserializer<LittleEndian, BytesInPointer> &operator >>(BasicDeserializer<LittleEndian, BytesInPointer> &stream, HKXMatrix4 &val) {
+		return stream >> val.v[0] >> val.v[1] >> val.v[2] >> val.v[3];
+	}
+
+	// Bulk equivalents of the above, for count consecutive values. All of the math types are plain arrays of floats.
+	template<typename Stream, typename T>
+	inline void readFloatArrays(Stream &stream, T *values, size_t count) {
+		static_assert(sizeof(T) % sizeof(float) == 0, "not an array of floats");
+
+		constexpr size_t floatsPerValue = sizeof(T) / sizeof(float);
+
+		if (count > SIZE_MAX / floatsPerValue) {
+			throwDeserializerError("out of bounds read");
+		}
+
+		stream.readFloats(reinterpret_cast<float *>(values), count * floatsPerValue);
+	}
+
+	template<typename Stream>
+	inline void readVector4s(Stream &stream, HKXVector4 *values, size_t count) {
+		readFloatArrays(stream, values, count);
+	}
+
+	template<typename Stream>
+	inline void readQuaternions(Stream &stream, HKXQuaternion *values, size_t count) {
+		readFloatArrays(stream, values, count);
+	}
+
+	template<typename Stream>
+	inline void readMatrix3s(Stream &stream, HKXMatrix3 *values, size_t count) {
+		readFloatArrays(stream, values, count);
+	}
+
+	template<typename Stream>
+	inline void readQsTransforms(Stream &stream, HKXQsTransform *values, size_t count) {
+		readFloatArrays(stream, values, count);
+	}
+
+	template<typename Stream>
+	inline void readMatrix4s(Stream &stream, HKXMatrix4 *values, size_t count) {
+		readFloatArrays(stream, values, count);
+	}
 
 }
 
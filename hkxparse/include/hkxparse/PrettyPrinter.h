@@ -27,10 +27,19 @@ namespace hkxparse {
 		void doPrint(const HKXMatrix4 &val);
 		void doPrint(const HKXStructRef &val);
 		void doPrint(const HKXArray &val);
-		void doPrint(const std::string &val);
+		void doPrint(const HKXStructArray &val);
+		void doPrint(const HKXStructArrayRow &val);
+		void doPrint(const HKXString &val);
+		void doPrint(const HKXStringView &val);
 		void doPrint(const HKXStruct &val);
-		void doPrint(const std::vector<unsigned char> &val);
+		void doPrint(const HKXByteArray &val);
+		void doPrint(int32_t val);
+		void doPrint(uint32_t val);
+
+		template<typename T>
+		void doPrint(const HKXTypedArray<T> &val);
 		
+		void printStructType(const HKXTypeDescriptor *type);
 		void printKey(const char *key);
 		void printValue(const char *value);
 		void printValueNoNewLine(const char *value);
@@ -2,6 +2,8 @@
 #define HKXPARSE_TAGFILE_TYPES_H
 
 #include <stdint.h>
+#include <string_view>
+#include <vector>
 
 namespace hkxparse {
 	enum : uint32_t {
@@ -44,18 +46,26 @@ namespace hkxparse {
 		uint32_t magic1;
 	};
 
+	// The names are views of the string pool entries, which point into the mapping.
 	struct TagfileMemberInfo {
-		std::string name;
+		std::string_view name;
 		int32_t type;
 		int32_t tupleSize; // Tuples only
-		std::string className; // Object and Struct only
+		std::string_view className; // Object and Struct only
+	};
+
+	// A member of a type or of one of its parents, at its index in the member bitmap
+	struct TagfileFlatMember {
+		const TagfileMemberInfo *info;
+		int32_t classIndex; // Object and Struct only: 0 if there is no class name, -1 if not declared yet
 	};
 
 	struct TagfileTypeInfo {
-		std::string name;
+		std::string_view name;
 		int32_t unk3;
 		int32_t parentTypeIndex;
 		std::vector<TagfileMemberInfo> members;
+		std::vector<TagfileFlatMember> allMembers; // parents first
 	};
 }
 
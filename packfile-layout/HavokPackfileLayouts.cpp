@@ -1,4 +1,5 @@
 #include <hkxparse/HavokPackfileLayouts.h>
+#include <hkxparse/HavokReflectionTypes.h>
 #include <hk_2010.2.0-r1_1-0-1-4.h>
 
 #include <string.h>
@@ -7,19 +8,66 @@ namespace hkxparse {
 	static const struct HavokPackfileLayout packfileLayouts[] = {
 		{ "hk_2010.2.0-r1", { 4, 1, 0, 1 },
 			hk_2010_2_0_r1_1_0_1_4Classes, sizeof(hk_2010_2_0_r1_1_0_1_4Classes) / sizeof(hk_2010_2_0_r1_1_0_1_4Classes[0]),
-			hk_2010_2_0_r1_1_0_1_4TypeInfo, sizeof(hk_2010_2_0_r1_1_0_1_4TypeInfo) / sizeof(hk_2010_2_0_r1_1_0_1_4TypeInfo[0])
+			hk_2010_2_0_r1_1_0_1_4TypeInfo, sizeof(hk_2010_2_0_r1_1_0_1_4TypeInfo) / sizeof(hk_2010_2_0_r1_1_0_1_4TypeInfo[0]),
+			{ hk_2010_2_0_r1_1_0_1_4ClassIndexDisplacements, hk_2010_2_0_r1_1_0_1_4ClassIndexSlots },
+			{ hk_2010_2_0_r1_1_0_1_4TypeInfoIndexDisplacements, hk_2010_2_0_r1_1_0_1_4TypeInfoIndexSlots }
 		},
 	};
 
+	// Must match name_hash in make_layout.rb
+	static unsigned int nameHash(const char *name, unsigned int seed) {
+		unsigned int hash = seed == 0 ? 0x811C9DC5U : seed;
+
+		for (auto ptr = reinterpret_cast<const unsigned char *>(name); *ptr; ptr++) {
+			hash = (hash ^ *ptr) * 0x01000193U;
+		}
+
+		return hash;
+	}
+
+	// Returns the only index the name may be at; the caller compares the names.
+	static unsigned int lookupName(const HavokNameIndex &index, unsigned int count, const char *name) {
+		auto displacement = index.displacements[nameHash(name, 0) % count];
+
+		if (displacement < 0) {
+			return index.slots[-displacement - 1];
+		}
+		else {
+			return index.slots[nameHash(name, static_cast<unsigned int>(displacement)) % count];
+		}
+	}
+
 	const HavokPackfileLayout *findLayout(const char *name, const unsigned char *layoutRules) {
 		for (size_t index = 0; index < sizeof(packfileLayouts) / sizeof(packfileLayouts[0]); index++) {
 			const auto &layout = packfileLayouts[index];
 
-			if (strcmp(layout.name, name) == 0 && memcmp(layout.layoutRules, layoutRules, sizeof(layoutRules)) == 0) {
+			if (strcmp(layout.name, name) == 0 && memcmp(layout.layoutRules, layoutRules, sizeof(layout.layoutRules)) == 0) {
 				return &layout;
 			}
 		}
 
 		return nullptr;
 	}
+
+	int findClassIndex(const HavokPackfileLayout *layout, const char *name) {
+		if (layout->classCount == 0)
+			return -1;
+
+		auto index = lookupName(layout->classIndex, layout->classCount, name);
+		if (strcmp(layout->classes[index]->name, name) != 0)
+			return -1;
+
+		return static_cast<int>(index);
+	}
+
+	int findTypeInfoIndex(const HavokPackfileLayout *layout, const char *name) {
+		if (layout->typeInfoCount == 0)
+			return -1;
+
+		auto index = lookupName(layout->typeInfoIndex, layout->typeInfoCount, name);
+		if (strcmp(layout->typeInfos[index]->name, name) != 0)
+			return -1;
+
+		return static_cast<int>(index);
+	}
 }
@@ -5,6 +5,16 @@ namespace hkxparse {
 	struct HavokClass;
 	struct HavokTypeInfo;
 
+	/*
+	 * Minimal perfect hash over the names of a table sorted by name, as
+	 * generated by make_layout.rb. Both arrays have as many entries as the
+	 * table.
+	 */
+	struct HavokNameIndex {
+		const int *displacements;
+		const unsigned int *slots;
+	};
+
 	struct HavokPackfileLayout {
 		const char *name;
 		unsigned char layoutRules[4];
@@ -12,9 +22,15 @@ namespace hkxparse {
 		unsigned int classCount;
 		const HavokTypeInfo *const *typeInfos;
 		unsigned int typeInfoCount;
+		HavokNameIndex classIndex;
+		HavokNameIndex typeInfoIndex;
 	};
 
 	const HavokPackfileLayout *findLayout(const char *name, const unsigned char *layoutRules);
+
+	// Index into layout->classes or layout->typeInfos, or -1 if there is no such name.
+	int findClassIndex(const HavokPackfileLayout *layout, const char *name);
+	int findTypeInfoIndex(const HavokPackfileLayout *layout, const char *name);
 }
 
 #endif
@@ -2,16 +2,91 @@
 
 require 'json'
 
-if ARGV.size != 3
-	warn "Usage: make_layout <INPUT JSON FILE> <OUTPUT HEADER FILE> <OUTPUT SOURCE FILE>"
+if ARGV.size != 5
+	warn "Usage: make_layout <INPUT JSON FILE> <OUTPUT HEADER FILE> <OUTPUT SOURCE FILE> <OUTPUT DECODERS HEADER FILE> <OUTPUT VIEWS HEADER FILE>"
 	exit 1
 end
 
-input_filename, header_filename, source_filename = ARGV
+input_filename, header_filename, source_filename, decoders_filename, views_filename = ARGV
 layout = JSON.parse File.read(input_filename)
 
 layout_name = File.basename(input_filename, ".json").gsub(/[-.]/, "_")
 
+classes_by_name = {}
+layout["classes"].each do |class_info|
+	classes_by_name[class_info["name"]] = class_info
+end
+
+# Must match nameHash in HavokPackfileLayouts.cpp: FNV-1a, with the seed
+# replacing the offset basis.
+def name_hash(name, seed)
+	hash = seed == 0 ? 0x811C9DC5 : seed
+	name.each_byte do |byte|
+		hash = ((hash ^ byte) * 0x01000193) & 0xFFFFFFFF
+	end
+	hash
+end
+
+# Minimal perfect hash (hash and displace) over the names, which are
+# indexed in the given order. Returns the displacement for every bucket
+# of the first level hash, and the name index for every slot. A
+# displacement >= 0 is the seed of the second level hash; a negative one
+# is the slot itself, as -slot - 1.
+def perfect_hash(names)
+	size = names.size
+	buckets = Array.new(size) { [] }
+	names.each_with_index do |name, index|
+		buckets[name_hash(name, 0) % size].push index
+	end
+
+	displacements = Array.new(size, 0)
+	slots = Array.new(size)
+
+	ordered = buckets.each_index.sort_by { |bucket| [ -buckets[bucket].size, bucket ] }
+
+	ordered.each do |bucket|
+		entries = buckets[bucket]
+		break if entries.size <= 1
+
+		seed = 1
+		loop do
+			positions = entries.map { |index| name_hash(names[index], seed) % size }
+
+			if positions.uniq.size == positions.size && positions.all? { |position| slots[position].nil? }
+				positions.zip(entries).each { |position, index| slots[position] = index }
+				displacements[bucket] = seed
+				break
+			end
+
+			seed += 1
+		end
+	end
+
+	free_slots = slots.each_index.select { |position| slots[position].nil? }
+
+	ordered.each do |bucket|
+		next unless buckets[bucket].size == 1
+
+		position = free_slots.shift
+		slots[position] = buckets[bucket].first
+		displacements[bucket] = -position - 1
+	end
+
+	[ displacements, slots ]
+end
+
+def write_name_index(outf, name, names)
+	displacements, slots = perfect_hash(names)
+
+	outf.puts "const int #{name}Displacements[] = {"
+	displacements.each_slice(16) { |values| outf.puts "  #{values.join(", ")}," }
+	outf.puts "};"
+
+	outf.puts "const unsigned int #{name}Slots[] = {"
+	slots.each_slice(16) { |values| outf.puts "  #{values.join(", ")}," }
+	outf.puts "};"
+end
+
 File.open(source_filename, "w") do |outf|
 	outf.write <<EOF
 /*
@@ -163,6 +238,9 @@ EOF
 
 	outf.puts "};"
 
+	write_name_index outf, "#{layout_name}ClassIndex", layout["classes"].map { |val| val["name"] }.sort
+	write_name_index outf, "#{layout_name}TypeInfoIndex", layout["typeinfo"].map { |val| val["name"] }.sort
+
 	outf.puts "}"
 end
 
@@ -180,9 +258,280 @@ namespace hkxparse {
 
 	extern const HavokClass *const #{layout_name}Classes[#{layout["classes"].size}];
 	extern const HavokTypeInfo *const #{layout_name}TypeInfo[#{layout["typeinfo"].size}];
+
+	// Perfect hashes over the names in #{layout_name}Classes and #{layout_name}TypeInfo
+	extern const int #{layout_name}ClassIndexDisplacements[#{layout["classes"].size}];
+	extern const unsigned int #{layout_name}ClassIndexSlots[#{layout["classes"].size}];
+	extern const int #{layout_name}TypeInfoIndexDisplacements[#{layout["typeinfo"].size}];
+	extern const unsigned int #{layout_name}TypeInfoIndexSlots[#{layout["typeinfo"].size}];
+}
+
+#endif
+EOF
+
+end
+
+File.open(decoders_filename, "w") do |outf|
+	outf.write <<EOF
+/*
+ * Automatically generated from #{input_filename}
+ *
+ * One decode function per class, reading all serialized members of the
+ * class and of its parents (parents first) at constant offsets into
+ * consecutive field slots. Decoder provides the Field type and the
+ * decode<Type, Subtype>(field, data, typeClass) primitive.
+ */
+#ifndef DECODERS_#{layout_name}
+#define DECODERS_#{layout_name}
+
+#include <hkxparse/HavokReflectionTypes.h>
+
+namespace hkxparse {
+namespace #{layout_name} {
+EOF
+
+	layout["classes"].each do |class_info|
+		outf.puts "extern const HavokClass #{class_info["name"]}Class;"
+	end
+
+	layout["classes"].each do |class_info|
+		chain = []
+		klass = class_info
+		while klass
+			chain.unshift klass
+			klass = klass["parent"] && classes_by_name.fetch(klass["parent"])
+		end
+
+		members = chain.flat_map { |klass| klass["members"] }.reject { |member| (member["flags"] & 1024) != 0 }
+
+		outf.puts
+		outf.puts "template<typename Decoder>"
+		if members.empty?
+			outf.puts "void #{class_info["name"]}Decode(Decoder &, const unsigned char *, typename Decoder::Field *) {"
+		else
+			outf.puts "void #{class_info["name"]}Decode(Decoder &decoder, const unsigned char *object, typename Decoder::Field *fields) {"
+		end
+
+		slot = 0
+		members.each do |member|
+			type, subtype = member["type"], member["subtype"]
+			type_class = member["class"].nil? ? "nullptr" : "&#{member["class"]}Class"
+
+			outf.puts "  decoder.template decode<static_cast<HavokType>(#{type}), static_cast<HavokType>(#{subtype})>(fields[#{slot}], object + #{member["offset"]}, #{type_class});"
+
+			slot += 1
+		end
+
+		outf.puts "}"
+	end
+
+	outf.puts "}"
+	outf.puts
+
+	sorted_classes = layout["classes"].sort_by { |val| val["name"] }
+
+	outf.write <<EOF
+// Indexed in the same order as #{layout_name}Classes.
+template<typename Decoder>
+struct #{layout_name}Decoders {
+  using Function = void (*)(Decoder &decoder, const unsigned char *object, typename Decoder::Field *fields);
+
+  static constexpr Function functions[#{sorted_classes.size}] = {
+EOF
+
+	sorted_classes.each do |klass|
+		outf.puts "    &#{layout_name}::#{klass["name"]}Decode<Decoder>,"
+	end
+
+	outf.write <<EOF
+  };
+};
 }
 
 #endif
 EOF
+end
+
+# C++ types of the members that are read by value in views, by HavokType
+VIEW_VALUE_TYPES = {
+	1 => "uint8_t", # Bool; only used for arrays, single values use readBool
+	2 => "char",
+	3 => "int8_t",
+	4 => "uint8_t",
+	5 => "int16_t",
+	6 => "uint16_t",
+	7 => "int32_t",
+	8 => "uint32_t",
+	9 => "int64_t",
+	10 => "uint64_t",
+	11 => "float",
+	12 => "HKXVector4",
+	13 => "HKXQuaternion",
+	14 => "HKXMatrix3",
+	15 => "HKXMatrix3",
+	16 => "HKXQsTransform",
+	17 => "HKXMatrix4",
+	18 => "HKXMatrix4",
+	30 => "PointerType", # ULong
+	32 => "uint16_t" # Half, undecoded
+}
+
+CPP_KEYWORDS = %w{
+	alignas alignof and and_eq asm auto bitand bitor bool break case catch char char16_t char32_t class
+	compl const constexpr const_cast continue decltype default delete do double dynamic_cast else enum
+	explicit export extern false float for friend goto if inline int long mutable namespace new noexcept
+	not not_eq nullptr operator or or_eq private protected public register reinterpret_cast return short
+	signed sizeof static static_assert static_cast struct switch template this thread_local throw true
+	try typedef typeid typename union unsigned using virtual void volatile wchar_t while xor xor_eq
+	className objectSize reflection objectData viewAs
+}
+
+def view_accessor(member)
+	type, subtype, array_size = member["type"], member["subtype"], member["arraySize"]
+	view = member["class"] && "#{member["class"]}View"
+	offset = member["offset"]
+
+	if array_size > 0
+		if VIEW_VALUE_TYPES.include? type
+			return "HKXPackfileArray<#{VIEW_VALUE_TYPES[type]}>", "readInlineArray<#{VIEW_VALUE_TYPES[type]}>(#{offset}, #{array_size})"
+		elsif type == 25 && view
+			return "HKXPackfileStructArray<#{view}>", "readInlineStructArray<#{view}>(#{offset}, #{array_size})"
+		else
+			return nil
+		end
+	end
+
+	case type
+	when 1
+		return "bool", "readBool(#{offset})"
+	when 24, 31 # Enum, Flags
+		value_type = VIEW_VALUE_TYPES[subtype]
+		return value_type && [ value_type, "readValue<#{value_type}>(#{offset})" ]
+	when 20
+		return subtype == 25 && view && [ view, "readObject<#{view}>(#{offset})" ]
+	when 25
+		return view && [ view, "readStruct<#{view}>(#{offset})" ]
+	when 29, 33
+		return "const char *", "readString(#{offset})"
+	when 22, 26 # Array, SimpleArray
+		if VIEW_VALUE_TYPES.include? subtype
+			return "HKXPackfileArray<#{VIEW_VALUE_TYPES[subtype]}>", "readArray<#{VIEW_VALUE_TYPES[subtype]}>(#{offset})"
+		elsif subtype == 25 && view
+			return "HKXPackfileStructArray<#{view}>", "readStructArray<#{view}>(#{offset})"
+		elsif subtype == 20 && view
+			return "HKXPackfilePointerArray<#{view}, PointerType>", "readPointerArray<#{view}>(#{offset})"
+		elsif subtype == 29 || subtype == 33
+			return "HKXPackfilePointerArray<const char *, PointerType>", "readPointerArray<const char *>(#{offset})"
+		else
+			return nil
+		end
+	else
+		value_type = VIEW_VALUE_TYPES[type]
+		return value_type && [ value_type, "readValue<#{value_type}>(#{offset})" ]
+	end
+end
+
+def declare(type, declarator)
+	type.end_with?("*") ? "#{type}#{declarator}" : "#{type} #{declarator}"
+end
+
+File.open(views_filename, "w") do |outf|
+	# hkBaseObject is just the vtable pointer
+	pointer_type = classes_by_name.fetch("hkBaseObject")["objectSize"] == 8 ? "uint64_t" : "uint32_t"
+
+	outf.write <<EOF
+/*
+ * Automatically generated from #{input_filename}
+ *
+ * Zero-copy views over fixed-up packfile objects, see HKXPackfileView.h.
+ * Members that have no view representation (void pointers, variants,
+ * serialize-ignored members, etc.) have no accessor.
+ */
+#ifndef VIEWS_#{layout_name}
+#define VIEWS_#{layout_name}
+
+#include <hkxparse/HavokReflectionTypes.h>
+#include <hkxparse/HKXPackfileView.h>
+
+namespace hkxparse {
+namespace #{layout_name} {
+using PointerType = #{pointer_type};
+using ObjectView = HKXPackfileObjectView<PointerType>;
+
+EOF
+
+	layout["classes"].each do |class_info|
+		outf.puts "extern const HavokClass #{class_info["name"]}Class;"
+	end
+
+	outf.puts
+
+	layout["classes"].each do |class_info|
+		outf.puts "class #{class_info["name"]}View;"
+	end
+
+	emitted = {}
+	ordered = []
+	visit = lambda do |class_info|
+		next if emitted[class_info["name"]]
+		visit.call(classes_by_name.fetch(class_info["parent"])) if class_info["parent"]
+		emitted[class_info["name"]] = true
+		ordered.push class_info
+	end
+	layout["classes"].each { |class_info| visit.call(class_info) }
+
+	accessors = {}
+
+	ordered.each do |class_info|
+		class_name = class_info["name"]
+		base = class_info["parent"] ? "#{class_info["parent"]}View" : "ObjectView"
+
+		outf.write <<EOF
+
+class #{class_name}View : public #{base} {
+public:
+  static constexpr const char *className = #{class_name.inspect};
+  static constexpr size_t objectSize = #{class_info["objectSize"]};
+  static inline const HavokClass *reflection() { return &#{class_name}Class; }
+
+  using #{base}::#{base};
+EOF
+
+		accessors[class_name] = []
+
+		class_info["members"].each do |member|
+			next if (member["flags"] & 1024) != 0
+
+			accessor = view_accessor(member)
+			next unless accessor
+
+			name = member["name"]
+			name += "_" if CPP_KEYWORDS.include? name
+			name = "_#{name}" if name =~ /\A[0-9]/
 
+			accessors[class_name].push [ name, *accessor ]
+
+			outf.puts "  inline #{declare(accessor[0], "#{name}() const")};"
+		end
+
+		outf.puts "};"
+	end
+
+	ordered.each do |class_info|
+		class_name = class_info["name"]
+		next if accessors[class_name].empty?
+
+		outf.puts
+
+		accessors[class_name].each do |name, type, expression|
+			outf.puts "inline #{declare(type, "#{class_name}View::#{name}() const")} { return #{expression}; }"
+		end
+	end
+
+	outf.write <<EOF
+}
+}
+
+#endif
+EOF
 end